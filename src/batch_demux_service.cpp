@@ -0,0 +1,215 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "batch_demux_service.h"
+#include "detail/demux_file.h"
+#include "detail/pes_batcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+
+namespace mpegts
+{
+namespace
+{
+batch_demux_service::batch_callback_factory_t to_batch_factory(
+    batch_demux_service::callback_factory_t make_callback)
+{
+  if (!make_callback)
+  {
+    return {};
+  }
+  return [make_callback = std::move(make_callback)](size_t file_index) {
+    return detail::make_batch_callback(make_callback(file_index));
+  };
+}
+} // namespace
+
+class batch_demux_service::impl
+{
+public:
+  impl(std::vector<std::string> file_names, boost::asio::io_context &signal_handling_ctx,
+      batch_callback_factory_t make_callback, size_t jobs, demux_settings settings)
+      : _file_names(std::move(file_names)), _signal_handling_ctx(signal_handling_ctx),
+        _make_callback(std::move(make_callback)), _jobs(std::max<size_t>(1, jobs)),
+        _settings(std::move(settings))
+  {
+    if (!_make_callback)
+    {
+      throw std::runtime_error("callback factory is not set");
+    }
+  }
+
+  void start()
+  {
+    stop();
+    join();
+
+    _next_file = 0;
+    _failed_files = 0;
+
+    const size_t threads = std::min(_jobs, _file_names.size());
+    _running_threads = threads;
+    if (!threads)
+    {
+      _signal_handling_ctx.stop();
+      return;
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Starting processing of " << _file_names.size() << " files on "
+                            << threads << " threads";
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+      _threads.push_back(std::make_unique<boost::thread>([this]() { run(); }));
+    }
+  }
+
+  void stop()
+  {
+    if (!_threads.empty())
+    {
+      BOOST_LOG_TRIVIAL(trace) << "Interrupting processing threads...";
+    }
+    for (auto &thread : _threads)
+    {
+      thread->interrupt();
+    }
+  }
+
+  void join()
+  {
+    if (_threads.empty())
+    {
+      return;
+    }
+
+    BOOST_LOG_TRIVIAL(trace) << "Joining processing threads...";
+    for (auto &thread : _threads)
+    {
+      thread->join();
+    }
+    _threads.clear();
+
+    BOOST_LOG_TRIVIAL(info) << "Processing threads finished, failed files: " << _failed_files;
+  }
+
+private:
+  const std::vector<std::string> _file_names;
+  boost::asio::io_context &_signal_handling_ctx;
+  const batch_callback_factory_t _make_callback;
+  const size_t _jobs;
+  const demux_settings _settings;
+
+  std::vector<std::unique_ptr<boost::thread>> _threads;
+  std::atomic<size_t> _next_file{0};
+  std::atomic<size_t> _failed_files{0};
+  std::atomic<size_t> _running_threads{0};
+
+  // takes files one by one until there are none left; PES buffers stay with the thread
+  // from one file to the next
+  void run()
+  {
+    detail::pes_buffer_pool buffer_pool;
+
+    try
+    {
+      for (size_t index = _next_file++; index < _file_names.size(); index = _next_file++)
+      {
+        if (!demux(index, buffer_pool))
+        {
+          ++_failed_files;
+        }
+      }
+    }
+    catch (const boost::thread_interrupted &)
+    {
+      BOOST_LOG_TRIVIAL(trace) << "Processing tread interrupted.";
+    }
+
+    if (--_running_threads == 0)
+    {
+      _signal_handling_ctx.stop();
+    }
+  }
+
+  bool demux(size_t index, detail::pes_buffer_pool &buffer_pool)
+  {
+    const auto &file_name = _file_names[index];
+
+    try
+    {
+      BOOST_LOG_TRIVIAL(info) << "Starting processing of file: " << file_name;
+      detail::demux_file(file_name, _settings, _make_callback(index), buffer_pool);
+      BOOST_LOG_TRIVIAL(info) << "Finished processing of file: " << file_name;
+      return true;
+    }
+    catch (const std::ios_base::failure &e)
+    {
+      BOOST_LOG_TRIVIAL(error) << file_name << ": " << e.what() << ": " << strerror(errno);
+    }
+    catch (const std::exception &e)
+    {
+      BOOST_LOG_TRIVIAL(error) << file_name << ": " << e.what();
+    }
+    return false;
+  }
+};
+
+batch_demux_service::batch_demux_service(std::vector<std::string> file_names,
+    boost::asio::io_context &signal_handling_ctx, callback_factory_t make_callback, size_t jobs,
+    demux_settings settings)
+    : batch_demux_service(std::move(file_names), signal_handling_ctx,
+          to_batch_factory(std::move(make_callback)), jobs, std::move(settings))
+{
+}
+
+batch_demux_service::batch_demux_service(std::vector<std::string> file_names,
+    boost::asio::io_context &signal_handling_ctx, batch_callback_factory_t make_callback,
+    size_t jobs, demux_settings settings)
+    : _impl(std::make_unique<impl>(std::move(file_names), signal_handling_ctx,
+          std::move(make_callback), jobs, std::move(settings)))
+{
+}
+
+batch_demux_service::~batch_demux_service()
+{
+}
+
+void batch_demux_service::start()
+{
+  _impl->start();
+}
+
+void batch_demux_service::stop()
+{
+  _impl->stop();
+}
+void batch_demux_service::join()
+{
+  _impl->join();
+}
+} // namespace mpegts
@@ -0,0 +1,65 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "demux_service.h"
+#include "mpegts.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+namespace mpegts
+{
+// demuxes many files in one process, up to jobs of them at a time, each on its own thread
+class batch_demux_service
+{
+public:
+  // makes the callback for file_names[file_index] right before the file is demuxed, on the
+  // thread demuxing it; the callback is destroyed once the file is done
+  using callback_factory_t = std::function<packet_received_callback_t(size_t file_index)>;
+  // same for callbacks taking PES in batches grouped by PID
+  using batch_callback_factory_t = std::function<batch_received_callback_t(size_t file_index)>;
+
+  explicit batch_demux_service(std::vector<std::string> file_names,
+      boost::asio::io_context &signal_listening_context, callback_factory_t make_callback,
+      size_t jobs, demux_settings settings = {});
+  explicit batch_demux_service(std::vector<std::string> file_names,
+      boost::asio::io_context &signal_listening_context, batch_callback_factory_t make_callback,
+      size_t jobs, demux_settings settings = {});
+  ~batch_demux_service();
+  batch_demux_service(const batch_demux_service &) = delete;
+  batch_demux_service &operator=(const batch_demux_service &) = delete;
+
+  void start();
+  void stop();
+  void join();
+
+private:
+  class impl;
+  std::unique_ptr<impl> _impl;
+};
+} // namespace mpegts
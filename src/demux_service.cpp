@@ -21,11 +21,9 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 */
 
 #include "demux_service.h"
-#include "detail/pes_parser.h"
-#include "detail/ts_parser.h"
-
-#include <array>
-#include <fstream>
+#include "detail/demux_file.h"
+#include "detail/pes_batcher.h"
+#include "detail/thread_affinity.h"
 
 #include <boost/log/trivial.hpp>
 #include <boost/thread.hpp>
@@ -36,9 +34,9 @@ class demux_service::impl
 {
 public:
   impl(std::string file_name, boost::asio::io_context &signal_handling_ctx,
-      packet_received_callback_t callback)
+      batch_received_callback_t callback, demux_settings settings)
       : _file_name(std::move(file_name)), _signal_handling_ctx(signal_handling_ctx),
-        _callback(std::move(callback))
+        _callback(std::move(callback)), _settings(std::move(settings))
   {
     if (!_callback)
     {
@@ -56,41 +54,21 @@ public:
       {
         BOOST_LOG_TRIVIAL(info) << "Starting processing of file: " << _file_name;
 
-        std::ifstream ifs;
-        auto exception_mask = ifs.exceptions() | std::ios::failbit;
-        ifs.exceptions(exception_mask);
-        ifs.open(_file_name, std::ios::in | std::ios::binary);
-
-        detail::ts_parser ts_parser;
-        detail::pes_parser pes_parser(_callback);
-
-        // reusing ts_packet avoids reallocating of std::array member
-        // Minor: array allocates on stack, so it is always pre-allocated.
-        detail::ts_packet_t ts_packet;
-
-        while (!ifs.eof())
+        if (!_settings.cpus.empty())
         {
-          boost::this_thread::interruption_point();
-
-          ifs.read(reinterpret_cast<char *>(&ts_packet.header), sizeof(uint32_t));
-          ifs.read(reinterpret_cast<char *>(ts_packet.data.data()), ts_packet.data.size());
-
-          if (auto parsed_packet = ts_parser.parse(std::move(ts_packet)))
-          {
-            pes_parser.feed_ts_packet(std::move(*parsed_packet));
-          }
+          detail::pin_current_thread(_settings.cpus.front());
         }
 
-        BOOST_LOG_TRIVIAL(trace) << "Flushing...";
-        pes_parser.flush();
+        detail::pes_buffer_pool buffer_pool;
+        detail::demux_file(_file_name, _settings, _callback, buffer_pool);
       }
       catch (const boost::thread_interrupted &)
       {
         BOOST_LOG_TRIVIAL(trace) << "Processing tread interrupted.";
       }
-      catch (const std::ios_base::failure &)
+      catch (const std::ios_base::failure &e)
       {
-        BOOST_LOG_TRIVIAL(error) << strerror(errno);
+        BOOST_LOG_TRIVIAL(error) << e.what() << ": " << strerror(errno);
       }
       catch (const std::exception &e)
       {
@@ -124,13 +102,22 @@ public:
 private:
   const std::string _file_name;
   boost::asio::io_context &_signal_handling_ctx;
-  packet_received_callback_t _callback;
+  const batch_received_callback_t _callback;
+  const demux_settings _settings;
   std::unique_ptr<boost::thread> _processing_thread;
 };
 
 demux_service::demux_service(std::string file_name, boost::asio::io_context &signal_handling_ctx,
-    packet_received_callback_t callback)
-    : _impl(std::make_unique<impl>(std::move(file_name), signal_handling_ctx, std::move(callback)))
+    packet_received_callback_t callback, demux_settings settings)
+    : demux_service(std::move(file_name), signal_handling_ctx,
+          detail::make_batch_callback(std::move(callback)), std::move(settings))
+{
+}
+
+demux_service::demux_service(std::string file_name, boost::asio::io_context &signal_handling_ctx,
+    batch_received_callback_t callback, demux_settings settings)
+    : _impl(std::make_unique<impl>(
+          std::move(file_name), signal_handling_ctx, std::move(callback), std::move(settings)))
 {
 }
 
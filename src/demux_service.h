@@ -26,16 +26,51 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/asio/io_context.hpp>
 
 namespace mpegts
 {
+enum class input_mode
+{
+  // memory-mapped file, packets are parsed straight from the mapped pages
+  mmap,
+  // buffered std::ifstream reads
+  stream,
+  // several large reads kept in flight through io_uring, falls back to read() if unavailable
+  uring
+};
+
+struct demux_settings
+{
+  input_mode mode = input_mode::mmap;
+  // only these PIDs are demuxed, all PIDs if empty
+  std::vector<uint16_t> pids;
+  // these PIDs are never demuxed, applied after pids
+  std::vector<uint16_t> exclude_pids;
+  // PES reassembly threads, 0 runs the whole demux on the reading thread
+  size_t workers = 0;
+  // threads calling the callback when workers is not 0, the callback may then be called
+  // concurrently, but always from the same thread for a given PID
+  size_t writers = 1;
+  // CPUs to pin threads to in order: reading thread, workers, writers; none pinned if empty
+  std::vector<int> cpus;
+  // threads demuxing the file as independent byte ranges, 0 reads it sequentially;
+  // ranges are always read from a memory-mapped file and workers are not used
+  size_t chunk_threads = 0;
+  // socket receive buffer of udp:// and rtp:// inputs
+  size_t udp_receive_buffer = 8 * 1024 * 1024;
+};
+
 class demux_service
 {
 public:
   explicit demux_service(std::string file_name, boost::asio::io_context &signal_listening_context,
-      packet_received_callback_t callback);
+      packet_received_callback_t callback, demux_settings settings = {});
+  // PES are delivered in batches grouped by PID
+  explicit demux_service(std::string file_name, boost::asio::io_context &signal_listening_context,
+      batch_received_callback_t callback, demux_settings settings = {});
   ~demux_service();
   demux_service(const demux_service &) = delete;
   demux_service &operator=(const demux_service &) = delete;
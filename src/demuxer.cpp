@@ -0,0 +1,104 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "demuxer.h"
+#include "detail/pes_batcher.h"
+#include "detail/pes_buffer_pool.h"
+#include "detail/ts_demux.h"
+
+#include <stdexcept>
+
+namespace mpegts
+{
+class demuxer::impl
+{
+public:
+  impl(batch_received_callback_t callback, demux_settings settings)
+      : _callback(std::move(callback)), _settings(std::move(settings))
+  {
+    if (!_callback)
+    {
+      throw std::runtime_error("callback is not set");
+    }
+    _demux = std::make_unique<detail::ts_demux>(_settings, _callback, _buffer_pool);
+  }
+
+  void push(const uint8_t *data, size_t length)
+  {
+    if (_finished)
+    {
+      throw std::logic_error("demuxer is already finished");
+    }
+    _demux->push(data, length);
+  }
+
+  void finish()
+  {
+    if (!_finished)
+    {
+      _finished = true;
+      _demux->finish();
+    }
+  }
+
+  uint64_t skipped_bytes() const
+  {
+    return _demux->skipped_bytes();
+  }
+
+private:
+  const batch_received_callback_t _callback;
+  const demux_settings _settings;
+  detail::pes_buffer_pool _buffer_pool;
+  std::unique_ptr<detail::ts_demux> _demux;
+  bool _finished = false;
+};
+
+demuxer::demuxer(packet_received_callback_t callback, demux_settings settings)
+    : demuxer(detail::make_batch_callback(std::move(callback)), std::move(settings))
+{
+}
+
+demuxer::demuxer(batch_received_callback_t callback, demux_settings settings)
+    : _impl(std::make_unique<impl>(std::move(callback), std::move(settings)))
+{
+}
+
+demuxer::~demuxer()
+{
+}
+
+void demuxer::push(const uint8_t *data, size_t length)
+{
+  _impl->push(data, length);
+}
+
+void demuxer::finish()
+{
+  _impl->finish();
+}
+
+uint64_t demuxer::skipped_bytes() const
+{
+  return _impl->skipped_bytes();
+}
+} // namespace mpegts
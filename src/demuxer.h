@@ -0,0 +1,62 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "demux_service.h"
+#include "mpegts.h"
+
+#include <memory>
+
+namespace mpegts
+{
+// demuxes TS held in memory: chunks of any size and alignment are pushed on the caller's
+// thread and PES are delivered to the callback from push() and finish(), or from writer
+// threads when settings.workers is set; input mode, chunk threads and network settings are
+// not used
+class demuxer
+{
+public:
+  explicit demuxer(packet_received_callback_t callback, demux_settings settings = {});
+  // PES are delivered in batches grouped by PID, one batch per pushed chunk at most
+  // (larger chunks are split into several batches)
+  explicit demuxer(batch_received_callback_t callback, demux_settings settings = {});
+  ~demuxer();
+  demuxer(const demuxer &) = delete;
+  demuxer &operator=(const demuxer &) = delete;
+
+  // partial packets at the end of the chunk are kept until the next push;
+  // once packet alignment is found, a PES is delivered by the push bringing its last byte,
+  // unbounded video PES (PES_packet_length 0) by the one bringing the next PES of their PID;
+  // the payload passed to the callback is only valid during the call
+  void push(const uint8_t *data, size_t length);
+  // end of input: delivers PES still in progress, nothing can be pushed afterwards
+  void finish();
+
+  // bytes dropped so far while looking for TS packet alignment
+  uint64_t skipped_bytes() const;
+
+private:
+  class impl;
+  std::unique_ptr<impl> _impl;
+};
+} // namespace mpegts
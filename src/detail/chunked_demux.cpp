@@ -0,0 +1,453 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "chunked_demux.h"
+#include "mmap_source.h"
+#include "pes_parser.h"
+#include "profiler.h"
+#include "psi_parser.h"
+#include "stats_counters.h"
+#include "sync_scanner.h"
+#include "ts_packetizer.h"
+#include "ts_parser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // byte range demuxed by one task, multiple of TS packet size
+    constexpr size_t CHUNK_SIZE = TS_PACKET_SIZE * 64 * 1024;
+    // bytes after a range its packetizer may look at to confirm alignment of the last packets,
+    // as it would in the middle of the file; packets starting there belong to the next range
+    constexpr size_t LOOKAHEAD_SIZE = (ts_packetizer::SYNC_DEPTH + 1) * TS_PACKET_SIZE;
+    // ranges in flight per thread, bounds memory held by results waiting to be stitched
+    constexpr size_t CHUNKS_IN_FLIGHT_PER_THREAD = 2;
+    // initial PSI scan stops once all programs are known or at the limit
+    constexpr size_t PSI_PROBE_STEP = TS_PACKET_SIZE * 1024;
+    constexpr size_t PSI_PROBE_LIMIT = TS_PACKET_SIZE * 64 * 1024;
+
+    // per-PID progress inside a range
+    enum class pes_state : uint8_t
+    {
+      // no packet yet
+      none,
+      // packets without PUSI so far, they continue the PES of the previous range
+      head,
+      // PUSI seen, packets go to pes_parser
+      started
+    };
+  } // namespace
+
+  // payload before the first PUSI of a PID in the range
+  struct pes_fragment
+  {
+    uint16_t pid;
+    pes_buffer data;
+  };
+
+  // first and last continuity counter of a PID in the range
+  struct continuity_edge
+  {
+    uint16_t pid;
+    int8_t first;
+    int8_t last;
+  };
+
+  struct chunk_result
+  {
+    std::vector<continuity_edge> continuity;
+    std::vector<pes_fragment> heads;
+    // PIDs with a PUSI in the range, their PES from the previous range are complete
+    std::vector<uint16_t> started_pids;
+    // PES started and completed in the range, in order of completion
+    std::vector<pes_packet_impl_t> complete;
+    // PES started in the range and still in progress at its end
+    std::vector<pes_packet_impl_t> in_progress;
+    uint64_t skipped_bytes = 0;
+    // PSI state at the end of the range
+    psi_parser psi;
+  };
+
+  namespace
+  {
+    template <typename Policy>
+    chunk_result demux_chunk(const uint8_t *data, size_t length, size_t lookahead_length,
+        const pid_filter &filter, const psi_parser &initial_psi)
+    {
+      chunk_result result;
+
+      ts_packetizer packetizer;
+      basic_ts_parser<Policy> ts_parser(filter);
+      psi_parser psi_parser(initial_psi);
+      ts_parser.set_psi_pids(psi_parser.psi_pids());
+      basic_pes_parser<pes_ready_callback_t, Policy> pes_parser(
+          [&result](pes_packet_impl_t &pes_packet) {
+            result.complete.push_back(std::move(pes_packet));
+          });
+
+      constexpr uint16_t NO_INDEX = 0xffff;
+      pid_table<uint16_t> continuity_index{NO_INDEX};
+      pid_table<uint16_t> head_index{NO_INDEX};
+      pid_table<pes_state> pes_states{pes_state::none};
+
+      auto on_ts_packet = [&](const ts_packet_view &ts_packet) {
+        uint16_t &index = continuity_index[ts_packet.pid];
+        if (index == NO_INDEX)
+        {
+          index = static_cast<uint16_t>(result.continuity.size());
+          result.continuity.push_back(
+              {ts_packet.pid, ts_packet.continuity_cnt, ts_packet.continuity_cnt});
+        }
+        result.continuity[index].last = ts_packet.continuity_cnt;
+
+        if (psi_parser.is_psi_pid(ts_packet.pid))
+        {
+          if (psi_parser.feed_ts_packet(ts_packet))
+          {
+            ts_parser.set_psi_pids(psi_parser.psi_pids());
+          }
+          return;
+        }
+        if (!psi_parser.is_media_pid(ts_packet.pid))
+        {
+          return;
+        }
+
+        pes_state &state = pes_states[ts_packet.pid];
+        if (!ts_packet.pusi && state != pes_state::started)
+        {
+          uint16_t &head = head_index[ts_packet.pid];
+          if (head == NO_INDEX)
+          {
+            head = static_cast<uint16_t>(result.heads.size());
+            result.heads.push_back({ts_packet.pid, {}});
+          }
+          result.heads[head].data.append(ts_packet.data + ts_packet.pes_offset,
+              TS_PACKET_DATA_SIZE - ts_packet.pes_offset);
+          state = pes_state::head;
+          return;
+        }
+        if (state != pes_state::started)
+        {
+          state = pes_state::started;
+          result.started_pids.push_back(ts_packet.pid);
+        }
+
+        pes_parser.feed_ts_packet(ts_packet, psi_parser.get_stream_type(ts_packet.pid));
+      };
+
+      auto on_packets = [&](const uint8_t *first, size_t count) {
+        const uint64_t offset = packetizer.input_offset(first);
+        if (offset < length)
+        {
+          const size_t in_range = (length - offset + TS_PACKET_SIZE - 1) / TS_PACKET_SIZE;
+          ts_parser.parse(first, std::min(count, in_range), on_ts_packet);
+        }
+      };
+
+      packetizer.push(data, length + lookahead_length, on_packets);
+      packetizer.flush(on_packets);
+
+      result.in_progress = pes_parser.take_pes_packets_in_progress();
+      result.skipped_bytes = packetizer.skipped_bytes();
+      result.psi = std::move(psi_parser);
+      return result;
+    }
+
+    // PSI state ranges start with until one of them changes it, so PIDs are selected and
+    // named the same from the first range on
+    psi_parser probe_psi(const uint8_t *data, size_t length)
+    {
+      ts_packetizer packetizer;
+      // unfiltered, only packets of PSI PIDs are looked at
+      basic_ts_parser<probe_parser_policy> ts_parser;
+      psi_parser psi_parser;
+
+      auto on_packets = [&](const uint8_t *first, size_t count) {
+        ts_parser.parse(first, count, [&psi_parser](const ts_packet_view &ts_packet) {
+          if (psi_parser.is_psi_pid(ts_packet.pid))
+          {
+            psi_parser.feed_ts_packet(ts_packet);
+          }
+        });
+      };
+
+      for (size_t offset = 0; offset < length && !psi_parser.has_all_programs();
+           offset += PSI_PROBE_STEP)
+      {
+        packetizer.push(data + offset, std::min(PSI_PROBE_STEP, length - offset), on_packets);
+      }
+      return psi_parser;
+    }
+  } // namespace
+
+  chunked_demux::chunked_demux(const std::string &file_name, const demux_settings &settings,
+      batch_received_callback_t callback)
+      : _file_name(file_name), _settings(settings), _callback(std::move(callback)),
+        _continuity_cnt(ts_parser::NO_CONTINUITY_CNT)
+  {
+  }
+
+  uint64_t chunked_demux::run()
+  {
+    mmap_source source(_file_name);
+    const buffer_slice file = source.mapping();
+    const pid_filter filter(_settings.pids, _settings.exclude_pids);
+
+    // PSI state ranges submitted from now on start with
+    auto psi = std::make_shared<const psi_parser>(
+        probe_psi(file.data, std::min(file.length, PSI_PROBE_LIMIT)));
+    // bumped when ranges in flight are to be redone, they skip their work if not started yet
+    std::atomic<uint64_t> generation{0};
+
+    boost::asio::thread_pool pool(_settings.chunk_threads);
+    std::deque<std::pair<size_t, std::future<chunk_result>>> in_flight;
+    const size_t max_in_flight = _settings.chunk_threads * CHUNKS_IN_FLIGHT_PER_THREAD;
+
+    size_t next_offset = 0;
+    uint64_t skipped_bytes = 0;
+
+    auto submit = [&]() {
+      // a range ends where the next one starts, at the first TS packet found at or after its
+      // nominal end, so both sides agree on the boundary even if alignment changed before it
+      const size_t offset = next_offset;
+      size_t end = std::min(file.length, offset + CHUNK_SIZE);
+      if (end < file.length)
+      {
+        const size_t sync = sync_scanner::find_sync(file.data + end,
+            std::min(file.length - end, CHUNK_SIZE), ts_packetizer::SYNC_DEPTH);
+        end = sync == sync_scanner::npos ? std::min(file.length, end + CHUNK_SIZE) : end + sync;
+      }
+      next_offset = end;
+
+      auto task = std::make_shared<std::packaged_task<chunk_result()>>(
+          [&file, &filter, &generation, task_generation = generation.load(), psi, offset, end]() {
+            if (generation.load() != task_generation)
+            {
+              return chunk_result();
+            }
+
+            const size_t lookahead_length = std::min(file.length - end, LOOKAHEAD_SIZE);
+#ifdef MPEGTS_PROFILING
+            if (profiling::is_enabled())
+            {
+              return demux_chunk<profiled<dynamic_parser_policy>>(
+                  file.data + offset, end - offset, lookahead_length, filter, *psi);
+            }
+#endif
+            return demux_chunk<dynamic_parser_policy>(
+                file.data + offset, end - offset, lookahead_length, filter, *psi);
+          });
+      in_flight.emplace_back(offset, task->get_future());
+      boost::asio::post(pool, [task]() { (*task)(); });
+    };
+
+    try
+    {
+      while (next_offset < file.length || !in_flight.empty())
+      {
+        while (next_offset < file.length && in_flight.size() < max_in_flight)
+        {
+          submit();
+        }
+
+        boost::this_thread::interruption_point();
+
+        auto result = in_flight.front().second.get();
+        const size_t offset = in_flight.front().first;
+        in_flight.pop_front();
+
+        stitch(result);
+        flush_batch();
+        skipped_bytes += result.skipped_bytes;
+        if (auto *counters = stats::local())
+        {
+          counters->skipped_bytes.add(result.skipped_bytes);
+        }
+
+        const size_t end = in_flight.empty() ? next_offset : in_flight.front().first;
+
+        // PAT or PMT changed in the range, the ranges after it started from stale PSI and
+        // are redone from the state it ended with, as a sequential run would continue
+        if (!result.psi.is_equivalent(*psi))
+        {
+          BOOST_LOG_TRIVIAL(debug) << "PSI changed in range at " << offset
+                                   << ", redoing the ranges after it";
+          ++generation;
+          in_flight.clear();
+          next_offset = end;
+          psi = std::make_shared<const psi_parser>(std::move(result.psi));
+        }
+
+        source.drop(offset, end - offset);
+      }
+    }
+    catch (...)
+    {
+      // queued ranges are abandoned, running ones finish before the mapping goes away
+      pool.stop();
+      pool.join();
+      throw;
+    }
+    pool.join();
+
+    for (size_t slot = 0; slot < _pes_packets.size(); ++slot)
+    {
+      const uint16_t pid = _pes_packets[slot].ts_packet_pid;
+      if (_pes_slots[pid] == slot)
+      {
+        emit_pes_in_progress(pid);
+      }
+    }
+    flush_batch();
+
+    return skipped_bytes;
+  }
+
+  void chunked_demux::stitch(chunk_result &result)
+  {
+    for (const auto &edge : result.continuity)
+    {
+      int8_t &continuity_cnt = _continuity_cnt[edge.pid];
+      if (!ts_parser::is_continuous(continuity_cnt, edge.first))
+      {
+        if (auto *counters = stats::local())
+        {
+          counters->pid(edge.pid).cc_errors.add(1);
+        }
+        ts_parser::warn_packet_loss(edge.pid);
+      }
+      continuity_cnt = edge.last;
+    }
+
+    // heads continue PES of the previous range, a head without one is a PES whose start was
+    // lost or is before the beginning of the file
+    for (auto &head : result.heads)
+    {
+      const uint16_t slot = _pes_slots[head.pid];
+      if (slot == NO_PES_SLOT)
+      {
+        continue;
+      }
+
+      auto &pes_data = _pes_packets[slot].data;
+      const size_t length = pes_bytes_to_take(_pes_packets[slot], head.data.size());
+      if (pes_data.size() + length > MAX_PES_SIZE)
+      {
+        pes_parser_base::warn_pes_too_large(head.pid);
+        _pes_packets[slot].data = pes_buffer();
+        _free_pes_slots.push_back(slot);
+        _pes_slots[head.pid] = NO_PES_SLOT;
+        continue;
+      }
+      pes_data.append(head.data.data(), length);
+      if (is_pes_complete(_pes_packets[slot]))
+      {
+        emit_pes_in_progress(head.pid);
+      }
+    }
+
+    for (auto pid : result.started_pids)
+    {
+      if (_pes_slots[pid] != NO_PES_SLOT)
+      {
+        emit_pes_in_progress(pid);
+      }
+    }
+
+    for (auto &pes_packet : result.complete)
+    {
+      emit(pes_packet);
+    }
+
+    for (auto &pes_packet : result.in_progress)
+    {
+      uint16_t &slot = _pes_slots[pes_packet.ts_packet_pid];
+      if (!_free_pes_slots.empty())
+      {
+        slot = _free_pes_slots.back();
+        _free_pes_slots.pop_back();
+      }
+      else
+      {
+        slot = static_cast<uint16_t>(_pes_packets.size());
+        _pes_packets.emplace_back();
+      }
+      _pes_packets[slot] = std::move(pes_packet);
+    }
+  }
+
+  void chunked_demux::emit(pes_packet_impl_t &pes_packet)
+  {
+    if (_batcher.add(pes_packet))
+    {
+      flush_batch();
+    }
+  }
+
+  void chunked_demux::flush_batch()
+  {
+#ifdef MPEGTS_PROFILING
+    std::optional<profiling::scope<true>> timer;
+    if (profiling::is_enabled() && !_batcher.empty())
+    {
+      timer.emplace(profiling::stage::sink);
+    }
+#endif
+    // buffers of stitched PES come from range threads, they aren't pooled here
+    _batcher.flush([](pes_packet_impl_t &) {});
+  }
+
+  void chunked_demux::emit_pes_in_progress(uint16_t pid)
+  {
+    uint16_t &slot = _pes_slots[pid];
+    auto &pes_packet = _pes_packets[slot];
+
+    if (finish_pes_packet(pes_packet))
+    {
+      if (auto *counters = stats::local())
+      {
+        counters->add_pes(pid, pes_packet_size(pes_packet));
+      }
+      emit(pes_packet);
+    }
+
+    pes_packet.data = pes_buffer();
+    _free_pes_slots.push_back(slot);
+    slot = NO_PES_SLOT;
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,75 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "demux_service.h"
+#include "mpegts.h"
+#include "mpegts_detail.h"
+#include "pes_batcher.h"
+#include "pid_table.h"
+
+#include <string>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  struct chunk_result;
+
+  // demuxes a file as consecutive byte ranges on settings.chunk_threads threads, each range
+  // with its own parsers; results are stitched in file order on the calling thread, which
+  // joins PES straddling range boundaries, checks continuity counters across them and calls
+  // the callback, so every PID gets its PES in the same order as with a single thread
+  class chunked_demux
+  {
+  public:
+    chunked_demux(const std::string &file_name, const demux_settings &settings,
+        batch_received_callback_t callback);
+
+    // returns the number of bytes skipped to keep TS packet alignment
+    uint64_t run();
+
+  private:
+    static constexpr uint16_t NO_PES_SLOT = 0xffff;
+
+    const std::string _file_name;
+    const demux_settings _settings;
+    batch_received_callback_t _callback;
+    // PES emitted while stitching a range go out as one batch
+    pes_batcher _batcher{_callback};
+
+    // stitching state, PES still in progress at the end of the last stitched range
+    pid_table<uint16_t> _pes_slots{NO_PES_SLOT};
+    std::vector<pes_packet_impl_t> _pes_packets;
+    std::vector<uint16_t> _free_pes_slots;
+    pid_table<int8_t> _continuity_cnt;
+
+    void stitch(chunk_result &result);
+    void emit(pes_packet_impl_t &pes_packet);
+    void flush_batch();
+    void emit_pes_in_progress(uint16_t pid);
+  };
+
+} // namespace detail
+} // namespace mpegts
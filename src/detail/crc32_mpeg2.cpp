@@ -0,0 +1,93 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "crc32_mpeg2.h"
+
+#include <array>
+#include <cstring>
+
+#include <boost/endian/conversion.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace crc32_mpeg2
+  {
+    namespace
+    {
+      constexpr uint32_t POLYNOMIAL = 0x04C11DB7;
+      constexpr size_t SLICES = 8;
+
+      using tables_t = std::array<std::array<uint32_t, 256>, SLICES>;
+
+      // slice-by-8: tables[k][b] is the CRC of byte b followed by k zero bytes, which lets
+      // 8 input bytes be folded into the CRC with 8 independent lookups
+      tables_t make_tables()
+      {
+        tables_t tables;
+
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+          uint32_t crc = b << 24;
+          for (int bit = 0; bit < 8; ++bit)
+          {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ POLYNOMIAL : crc << 1;
+          }
+          tables[0][b] = crc;
+        }
+        for (size_t k = 1; k < SLICES; ++k)
+        {
+          for (uint32_t b = 0; b < 256; ++b)
+          {
+            const uint32_t prev = tables[k - 1][b];
+            tables[k][b] = (prev << 8) ^ tables[0][prev >> 24];
+          }
+        }
+        return tables;
+      }
+
+      const tables_t tables = make_tables();
+    } // namespace
+
+    uint32_t compute(const uint8_t *data, size_t length, uint32_t crc)
+    {
+      for (; length >= SLICES; data += SLICES, length -= SLICES)
+      {
+        uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc ^= boost::endian::big_to_native(word);
+
+        crc = tables[7][crc >> 24] ^ tables[6][(crc >> 16) & 0xff] ^
+              tables[5][(crc >> 8) & 0xff] ^ tables[4][crc & 0xff] ^ tables[3][data[4]] ^
+              tables[2][data[5]] ^ tables[1][data[6]] ^ tables[0][data[7]];
+      }
+      for (; length; ++data, --length)
+      {
+        crc = (crc << 8) ^ tables[0][(crc >> 24) ^ *data];
+      }
+      return crc;
+    }
+  } // namespace crc32_mpeg2
+
+} // namespace detail
+} // namespace mpegts
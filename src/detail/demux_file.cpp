@@ -0,0 +1,83 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "demux_file.h"
+#include "chunked_demux.h"
+#include "input_source.h"
+#include "pipe_source.h"
+#include "ts_demux.h"
+#include "udp_source.h"
+
+#include <stdexcept>
+
+#include <boost/log/trivial.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    void log_skipped_bytes(uint64_t skipped_bytes)
+    {
+      if (skipped_bytes)
+      {
+        BOOST_LOG_TRIVIAL(warning)
+            << "Skipped " << skipped_bytes << " bytes to keep TS packet alignment";
+      }
+    }
+
+    void demux_sequentially(const std::string &file_name, const demux_settings &settings,
+        const batch_received_callback_t &callback, pes_buffer_pool &buffer_pool)
+    {
+      auto source = make_input_source(file_name, settings);
+      ts_demux demux(settings, callback, buffer_pool);
+
+      for (auto block = source->read(); block.length; block = source->read())
+      {
+        demux.push(block.data, block.length);
+      }
+      demux.finish();
+      log_skipped_bytes(demux.skipped_bytes());
+    }
+  } // namespace
+
+  void demux_file(const std::string &file_name, const demux_settings &settings,
+      const batch_received_callback_t &callback, pes_buffer_pool &buffer_pool)
+  {
+    if (settings.chunk_threads && (is_network_url(file_name) || is_stream_input(file_name)))
+    {
+      throw std::invalid_argument("Live input can't be demuxed in chunks: " + file_name);
+    }
+
+    if (settings.chunk_threads)
+    {
+      chunked_demux chunked_demux(file_name, settings, callback);
+      log_skipped_bytes(chunked_demux.run());
+    }
+    else
+    {
+      demux_sequentially(file_name, settings, callback, buffer_pool);
+    }
+  }
+} // namespace detail
+} // namespace mpegts
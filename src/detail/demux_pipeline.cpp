@@ -0,0 +1,292 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "demux_pipeline.h"
+#include "pes_batcher.h"
+#include "pes_parser.h"
+#include "profiler.h"
+#include "thread_affinity.h"
+
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+#include <boost/log/trivial.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // ~800 KiB of TS packets per worker
+    constexpr size_t TS_RING_CAPACITY = 4096;
+    constexpr size_t PES_RING_CAPACITY = 256;
+    // packets a worker takes before it looks at returned buffers again
+    constexpr size_t WORKER_BATCH_SIZE = 256;
+
+    constexpr int NO_CPU = -1;
+
+    // threads are pinned in order: reading thread, workers, writers
+    int get_cpu(const std::vector<int> &cpus, size_t thread_index)
+    {
+      return thread_index < cpus.size() ? cpus[thread_index] : NO_CPU;
+    }
+  } // namespace
+
+  demux_pipeline::worker_state::worker_state(size_t writers) : input(TS_RING_CAPACITY)
+  {
+    for (size_t i = 0; i < writers; ++i)
+    {
+      output.push_back(std::make_unique<spsc_ring<pes_packet_impl_t>>(PES_RING_CAPACITY));
+      recycled.push_back(std::make_unique<spsc_ring<pes_buffer>>(PES_RING_CAPACITY));
+    }
+  }
+
+  demux_pipeline::demux_pipeline(
+      const demux_settings &settings, batch_received_callback_t callback)
+      : _callback(std::move(callback))
+  {
+    if (!settings.workers || !settings.writers)
+    {
+      throw std::invalid_argument("pipeline needs at least one worker and one writer");
+    }
+
+    for (size_t i = 0; i < settings.workers; ++i)
+    {
+      _workers.push_back(std::make_unique<worker_state>(settings.writers));
+    }
+
+    size_t thread_index = 1;
+    for (auto &worker : _workers)
+    {
+      const int cpu = get_cpu(settings.cpus, thread_index++);
+      worker->thread = boost::thread([this, &worker = *worker, cpu]() { run_worker(worker, cpu); });
+    }
+    for (size_t i = 0; i < settings.writers; ++i)
+    {
+      const int cpu = get_cpu(settings.cpus, thread_index++);
+      _writers.emplace_back([this, i, cpu]() { run_writer(i, cpu); });
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Pipeline started with " << settings.workers << " workers and "
+                            << settings.writers << " writers";
+  }
+
+  demux_pipeline::~demux_pipeline()
+  {
+    finish();
+  }
+
+  void demux_pipeline::push(const ts_packet_view &ts_packet, uint8_t stream_type)
+  {
+    if (_writer_failed.load(std::memory_order_relaxed))
+    {
+      throw std::runtime_error("PES writer failed");
+    }
+
+    auto &input = _workers[ts_packet.pid % _workers.size()]->input;
+    input.push_with([&](queued_ts_packet &queued) {
+      queued.view = ts_packet;
+      queued.stream_type = stream_type;
+      std::memcpy(queued.data.data(), ts_packet.data, TS_PACKET_DATA_SIZE);
+    });
+  }
+
+  void demux_pipeline::finish()
+  {
+    if (_finished)
+    {
+      return;
+    }
+    _finished = true;
+
+    // every stage drains its input and closes its output once the input is closed
+    for (auto &worker : _workers)
+    {
+      worker->input.close();
+    }
+    for (auto &worker : _workers)
+    {
+      worker->thread.join();
+    }
+    for (auto &writer : _writers)
+    {
+      writer.join();
+    }
+  }
+
+  void demux_pipeline::run_worker(worker_state &worker, int cpu)
+  {
+    if (cpu != NO_CPU)
+    {
+      pin_current_thread(cpu);
+    }
+
+#ifdef MPEGTS_PROFILING
+    if (profiling::is_enabled())
+    {
+      reassemble<profiled<dynamic_parser_policy>>(worker);
+      return;
+    }
+#endif
+    reassemble<dynamic_parser_policy>(worker);
+  }
+
+  template <typename Policy>
+  void demux_pipeline::reassemble(worker_state &worker)
+  {
+    const size_t writers = worker.output.size();
+
+    // complete PES leave with their buffer, writers hand the buffer back when done
+    basic_pes_parser<pes_ready_callback_t, Policy> pes_parser(
+        [&worker, writers](pes_packet_impl_t &pes_packet) {
+          worker.output[pes_packet.ts_packet_pid % writers]->push(std::move(pes_packet));
+        });
+
+    auto feed = [&pes_parser](queued_ts_packet &queued) {
+      queued.view.data = queued.data.data();
+      pes_parser.feed_ts_packet(queued.view, queued.stream_type);
+    };
+
+    for (unsigned spins = 0;;)
+    {
+      for (auto &recycled : worker.recycled)
+      {
+        pes_buffer buffer;
+        while (recycled->try_pop(buffer))
+        {
+          pes_parser.recycle(std::move(buffer));
+        }
+      }
+
+      const bool closed = worker.input.is_closed();
+      size_t count = 0;
+      while (count < WORKER_BATCH_SIZE && worker.input.try_consume(feed))
+      {
+        ++count;
+      }
+
+      if (count)
+      {
+        spins = 0;
+      }
+      else if (closed)
+      {
+        break;
+      }
+      else
+      {
+        spsc_ring<queued_ts_packet>::backoff(spins++);
+      }
+    }
+
+    pes_parser.flush();
+
+    for (auto &output : worker.output)
+    {
+      output->close();
+    }
+  }
+
+  void demux_pipeline::run_writer(size_t writer_index, int cpu)
+  {
+    if (cpu != NO_CPU)
+    {
+      pin_current_thread(cpu);
+    }
+
+    bool failed = false;
+    pes_packet_impl_t pes_packet;
+    pes_batcher batcher(_callback);
+#ifdef MPEGTS_PROFILING
+    const bool profile = profiling::is_enabled();
+#endif
+
+    // after a failure PES are still drained, so workers never block on this writer
+    auto flush = [&]() {
+#ifdef MPEGTS_PROFILING
+      std::optional<profiling::scope<true>> timer;
+      if (profile && !batcher.empty())
+      {
+        timer.emplace(profiling::stage::sink);
+      }
+#endif
+      // the buffer is dropped if its worker hasn't taken the previous ones back yet
+      auto release = [&](pes_packet_impl_t &released) {
+        auto &worker = *_workers[released.ts_packet_pid % _workers.size()];
+        worker.recycled[writer_index]->try_push(std::move(released.data));
+      };
+      if (failed)
+      {
+        batcher.flush([](pes_packet_impl_t &) {});
+        return;
+      }
+      try
+      {
+        batcher.flush(release);
+      }
+      catch (const std::exception &e)
+      {
+        BOOST_LOG_TRIVIAL(error) << e.what();
+        failed = true;
+        _writer_failed.store(true, std::memory_order_relaxed);
+      }
+    };
+
+    for (unsigned spins = 0;;)
+    {
+      bool all_closed = true;
+      bool idle = true;
+
+      for (auto &worker : _workers)
+      {
+        auto &output = *worker->output[writer_index];
+        all_closed = output.is_closed() && all_closed;
+
+        while (output.try_pop(pes_packet))
+        {
+          idle = false;
+          if (batcher.add(pes_packet))
+          {
+            flush();
+          }
+        }
+      }
+      flush();
+
+      if (all_closed)
+      {
+        break;
+      }
+      if (idle)
+      {
+        spsc_ring<pes_packet_impl_t>::backoff(spins++);
+      }
+      else
+      {
+        spins = 0;
+      }
+    }
+  }
+} // namespace detail
+} // namespace mpegts
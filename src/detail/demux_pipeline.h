@@ -0,0 +1,92 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "demux_service.h"
+#include "mpegts.h"
+#include "mpegts_detail.h"
+#include "spsc_ring.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  // PES reassembly and the callback moved off the reading thread: TS packets are dispatched
+  // to settings.workers reassembly threads by PID, complete PES go to settings.writers
+  // threads calling the callback with what each drain of their rings brought, all stages are
+  // connected with SPSC rings;
+  // a PID always maps to the same worker and writer, so its PES keep their order
+  class demux_pipeline
+  {
+  public:
+    demux_pipeline(const demux_settings &settings, batch_received_callback_t callback);
+    ~demux_pipeline();
+    demux_pipeline(const demux_pipeline &) = delete;
+    demux_pipeline &operator=(const demux_pipeline &) = delete;
+
+    // reading thread side, copies the packet into the ring of the worker owning its PID;
+    // throws if a writer failed
+    void push(const ts_packet_view &ts_packet, uint8_t stream_type);
+    // flushes PES in progress and waits for all stages to drain
+    void finish();
+
+  private:
+    struct queued_ts_packet
+    {
+      ts_packet_view view;
+      uint8_t stream_type;
+      std::array<uint8_t, TS_PACKET_DATA_SIZE> data;
+    };
+
+    struct worker_state
+    {
+      explicit worker_state(size_t writers);
+
+      spsc_ring<queued_ts_packet> input;
+      // one ring per writer for complete PES and one back for their buffers
+      std::vector<std::unique_ptr<spsc_ring<pes_packet_impl_t>>> output;
+      std::vector<std::unique_ptr<spsc_ring<pes_buffer>>> recycled;
+      boost::thread thread;
+    };
+
+    batch_received_callback_t _callback;
+    std::vector<std::unique_ptr<worker_state>> _workers;
+    std::vector<boost::thread> _writers;
+    std::atomic<bool> _writer_failed{false};
+    bool _finished = false;
+
+    void run_worker(worker_state &worker, int cpu);
+    template <typename Policy>
+    void reassemble(worker_state &worker);
+    void run_writer(size_t writer_index, int cpu);
+  };
+
+} // namespace detail
+} // namespace mpegts
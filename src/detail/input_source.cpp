@@ -0,0 +1,61 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "input_source.h"
+#include "demux_service.h"
+#include "mmap_source.h"
+#include "pipe_source.h"
+#include "stream_source.h"
+#include "udp_source.h"
+#include "uring_source.h"
+
+#include <stdexcept>
+
+namespace mpegts
+{
+namespace detail
+{
+  std::unique_ptr<input_source> make_input_source(
+      const std::string &file_name, const demux_settings &settings)
+  {
+    if (is_network_url(file_name))
+    {
+      return std::make_unique<udp_source>(file_name, settings.udp_receive_buffer);
+    }
+    if (is_stream_input(file_name))
+    {
+      return std::make_unique<pipe_source>(file_name);
+    }
+
+    switch (settings.mode)
+    {
+      case input_mode::mmap:
+        return std::make_unique<mmap_source>(file_name);
+      case input_mode::stream:
+        return std::make_unique<stream_source>(file_name);
+      case input_mode::uring:
+        return std::make_unique<uring_source>(file_name);
+    }
+    throw std::invalid_argument("unknown input mode");
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,53 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "mpegts.h"
+
+#include <memory>
+#include <string>
+
+namespace mpegts
+{
+struct demux_settings;
+
+namespace detail
+{
+  // source of raw TS bytes, consumed block by block by the processing thread
+  class input_source
+  {
+  public:
+    virtual ~input_source() = default;
+
+    // returns the next block of input which stays valid until the next call;
+    // empty block means end of input
+    virtual buffer_slice read() = 0;
+  };
+
+  // file_name is a file read as settings.mode asks, "-" for stdin, a FIFO or a udp:// or
+  // rtp:// URL
+  std::unique_ptr<input_source> make_input_source(
+      const std::string &file_name, const demux_settings &settings);
+
+} // namespace detail
+} // namespace mpegts
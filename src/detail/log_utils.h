@@ -6,9 +6,11 @@ namespace mpegts
 {
 namespace detail
 {
+  // packets go to the binary packet trace, see trace_ring.h; nothing is written while the
+  // trace is not running
   namespace log_utils
   {
-    void log_ts_packet(const ts_packet_t &ts_packet, uint64_t ts_packet_num);
+    void log_ts_packet(const ts_packet_view &ts_packet, uint64_t ts_packet_num);
     void log_pes_packet(const pes_packet_impl_t &pes_packet, size_t pes_packet_num);
   } // namespace log_utils
 } // namespace detail
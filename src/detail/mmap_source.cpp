@@ -0,0 +1,124 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "mmap_source.h"
+#include "mpegts_detail.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // size of a view handed out per read(), multiple of TS packet size;
+    // consumed views are dropped from the mapping to keep resident set flat on huge files
+    constexpr size_t MMAP_VIEW_SIZE = TS_PACKET_SIZE * 64 * 1024;
+
+    std::system_error make_error(const std::string &what, const std::string &file_name)
+    {
+      return std::system_error(errno, std::generic_category(), what + " " + file_name);
+    }
+  } // namespace
+
+  mmap_source::mmap_source(const std::string &file_name)
+  {
+    const int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      throw make_error("Failed to open", file_name);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      const auto error = make_error("Failed to stat", file_name);
+      ::close(fd);
+      throw error;
+    }
+
+    _size = static_cast<size_t>(st.st_size);
+
+    if (_size)
+    {
+      void *addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED)
+      {
+        const auto error = make_error("Failed to map", file_name);
+        ::close(fd);
+        throw error;
+      }
+      _data = static_cast<uint8_t *>(addr);
+
+      // hints only, failures are not fatal
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      ::madvise(_data, _size, MADV_SEQUENTIAL);
+    }
+
+    // mapping stays valid after the descriptor is closed
+    ::close(fd);
+  }
+
+  mmap_source::~mmap_source()
+  {
+    if (_data)
+    {
+      ::munmap(_data, _size);
+    }
+  }
+
+  void mmap_source::drop(size_t offset, size_t length)
+  {
+    const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t first = (offset + page_size - 1) / page_size * page_size;
+    const size_t last = std::min(offset + length, _size) / page_size * page_size;
+
+    if (first < last)
+    {
+      ::madvise(_data + first, last - first, MADV_DONTNEED);
+    }
+  }
+
+  buffer_slice mmap_source::read()
+  {
+    if (_offset)
+    {
+      // previous view is consumed, view size is a multiple of page size so it starts page aligned
+      ::madvise(_data + _offset - _view_length, _view_length, MADV_DONTNEED);
+    }
+
+    const size_t length = std::min(MMAP_VIEW_SIZE, _size - _offset);
+    buffer_slice view{_data + _offset, length};
+    _offset += length;
+    _view_length = length;
+
+    return view;
+  }
+} // namespace detail
+} // namespace mpegts
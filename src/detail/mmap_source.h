@@ -0,0 +1,60 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "input_source.h"
+
+#include <string>
+
+namespace mpegts
+{
+namespace detail
+{
+  // maps the whole file read-only and hands it out as views of the mapped pages,
+  // so the parsers read straight from the page cache with no staging copy
+  class mmap_source : public input_source
+  {
+  public:
+    explicit mmap_source(const std::string &file_name);
+    ~mmap_source() override;
+    mmap_source(const mmap_source &) = delete;
+    mmap_source &operator=(const mmap_source &) = delete;
+
+    buffer_slice read() override;
+
+    // the whole mapping, for callers reading it out of order instead of with read()
+    buffer_slice mapping() const
+    {
+      return buffer_slice{_data, _size};
+    }
+    // drops pages fully inside the given consumed range from the mapping
+    void drop(size_t offset, size_t length);
+
+  private:
+    uint8_t *_data = nullptr;
+    size_t _size = 0;
+    size_t _offset = 0;
+    size_t _view_length = 0;
+  };
+} // namespace detail
+} // namespace mpegts
@@ -22,8 +22,10 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #pragma once
 
-#include <array>
-#include <optional>
+#include "mpegts.h"
+#include "pes_buffer_pool.h"
+
+#include <cstdint>
 
 namespace mpegts
 {
@@ -31,13 +33,15 @@ namespace detail
 {
   // https://en.wikipedia.org/wiki/MPEG_transport_stream#Important_elements_of_a_transport_stream
   constexpr const uint8_t TS_PACKET_SIZE = 188;
-  using ts_packet_data_t = std::array<uint8_t, TS_PACKET_SIZE - sizeof(uint32_t)>;
+  constexpr const uint8_t TS_PACKET_DATA_SIZE = TS_PACKET_SIZE - sizeof(uint32_t);
 
-  struct ts_packet_t
+  // non-owning view of a TS packet in the input block with its decoded header fields
+  struct ts_packet_view
   {
     uint32_t header;
 
-    ts_packet_data_t data;
+    // TS_PACKET_DATA_SIZE bytes following the header, points into the input block
+    const uint8_t *data;
 
     uint16_t sync_byte;
     bool transport_error;
@@ -46,27 +50,35 @@ namespace detail
     uint16_t pid;
     uint8_t adaptation_field_ctl;
 
-    std::optional<uint8_t> pes_offset;
+    // offset of the payload in data
+    uint8_t pes_offset;
   };
 
-  using ts_packet_opt = std::optional<ts_packet_t>;
-
-  // https://ffmpeg.org/doxygen/3.2/mpegts_8c_source.html
-  const size_t MAX_PES_PAYLOAD_SIZE = 1024 * 200;
+  // sanity limit for a single PES, it is dropped when it grows beyond that
+  constexpr size_t MAX_PES_SIZE = 64 * 1024 * 1024;
 
   struct pes_packet_impl_t
   {
     uint32_t start_code;
     uint16_t ts_packet_pid;
     uint16_t stream_id;
+    uint8_t stream_type;
     size_t max_length;
 
-    std::array<uint8_t, MAX_PES_PAYLOAD_SIZE> data;
-    size_t cur_length;
+    // PES bytes following PES_packet_length, taken from pes_buffer_pool
+    pes_buffer data;
 
     uint16_t payload_offset;
-    uint16_t payload_length;
+    size_t payload_length;
   };
 
+  // public view of a ready PES, valid while pes_packet.data is
+  inline pes_packet_t make_pes_packet(const pes_packet_impl_t &pes_packet)
+  {
+    const uint8_t *payload = pes_packet.data.data() + pes_packet.payload_offset;
+    return pes_packet_t{pes_packet.ts_packet_pid, pes_packet.stream_type,
+        buffer_slice{payload, pes_packet.payload_length}};
+  }
+
 } // namespace detail
 } // namespace mpegts
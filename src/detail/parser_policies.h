@@ -0,0 +1,141 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "logger.h"
+
+#include <cstdint>
+
+namespace mpegts
+{
+namespace detail
+{
+  // accepted PES stream_id values, indexed by the stream_id byte of the start code
+  struct stream_id_table
+  {
+    bool accepted[256];
+
+    constexpr bool accepts(uint16_t stream_id) const
+    {
+      return accepted[stream_id & 0xff];
+    }
+  };
+
+  // every stream but those which never carry media: program_stream_map, private_stream_2,
+  // ECM, EMM, program_stream_directory, DSMCC_stream and ITU-T H.222.1 type E
+  // https://ffmpeg.org/doxygen/3.2/mpegts_8c_source.html
+  constexpr stream_id_table make_media_stream_ids()
+  {
+    stream_id_table table{};
+    for (auto &accepted : table.accepted)
+    {
+      accepted = true;
+    }
+    for (uint8_t stream_id : {0xbc, 0xbf, 0xf0, 0xf1, 0xf2, 0xf8, 0xff})
+    {
+      table.accepted[stream_id] = false;
+    }
+    return table;
+  }
+
+  inline constexpr stream_id_table MEDIA_STREAM_IDS = make_media_stream_ids();
+
+  enum class continuity_check
+  {
+    off,
+    on,
+    // decided by the ts_parser constructor argument
+    runtime
+  };
+
+  // parser policies select at compile time what the per-packet path does besides parsing:
+  //   log_ts_packets(), log_pes_packets() - dump every packet
+  //   trace                               - trace messages for every dropped packet
+  //   continuity                          - continuity counter checking
+  //   stream_ids                          - PES stream_id values passed on
+  //   stats                               - per-PID counters, see stats_counters.h
+  //   profile                             - stage timers, see profiler.h
+
+  // behaviour as configured at run time: dumps follow logger::log_ts_packets and
+  // logger::log_pes_packets, trace messages follow the log level
+  struct dynamic_parser_policy
+  {
+    static bool log_ts_packets()
+    {
+      return logger::log_ts_packets;
+    }
+    static bool log_pes_packets()
+    {
+      return logger::log_pes_packets;
+    }
+    static constexpr bool trace = true;
+    static constexpr continuity_check continuity = continuity_check::runtime;
+    static constexpr const stream_id_table &stream_ids = MEDIA_STREAM_IDS;
+    static constexpr bool stats = true;
+    static constexpr bool profile = false;
+  };
+
+  // nothing but parsing and continuity checking, for when packet dumps and trace logging are
+  // off; warnings are still logged
+  struct quiet_parser_policy
+  {
+    static constexpr bool log_ts_packets()
+    {
+      return false;
+    }
+    static constexpr bool log_pes_packets()
+    {
+      return false;
+    }
+    static constexpr bool trace = false;
+    static constexpr continuity_check continuity = continuity_check::on;
+    static constexpr const stream_id_table &stream_ids = MEDIA_STREAM_IDS;
+    static constexpr bool stats = true;
+    static constexpr bool profile = false;
+  };
+
+  // a pass over packets which are demuxed by another one, e.g. looking for PSI ahead
+  struct probe_parser_policy : quiet_parser_policy
+  {
+    static constexpr continuity_check continuity = continuity_check::off;
+    static constexpr bool stats = false;
+  };
+
+#ifdef MPEGTS_PROFILING
+  // Policy with every stage timed, for --profile; logging stays as Policy has it
+  template <typename Policy>
+  struct profiled : Policy
+  {
+    static constexpr bool profile = true;
+  };
+#endif
+
+  // whether the packet path may use quiet_parser_policy with the current logger settings
+  inline bool is_quiet_logging()
+  {
+    return !logger::log_ts_packets && !logger::log_pes_packets &&
+           logger::current_severity_level > boost::log::trivial::trace;
+  }
+
+} // namespace detail
+} // namespace mpegts
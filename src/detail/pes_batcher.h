@@ -0,0 +1,123 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "mpegts.h"
+#include "mpegts_detail.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // collects complete PES and hands them to a batch callback grouped by PID, so the consumer
+  // does its per-PID work once per run of packets instead of once per packet
+  class pes_batcher
+  {
+  public:
+    // upper bound of PES held back, keeps memory flat when the input comes as one huge block
+    static constexpr size_t MAX_BATCH_SIZE = 256;
+
+    explicit pes_batcher(const batch_received_callback_t &callback) : _callback(callback)
+    {
+      _pending.reserve(MAX_BATCH_SIZE);
+      _packets.reserve(MAX_BATCH_SIZE);
+    }
+
+    // takes pes_packet.data; returns true when the batch is full and should be flushed
+    bool add(pes_packet_impl_t &pes_packet)
+    {
+      _pending.push_back(std::move(pes_packet));
+      return _pending.size() >= MAX_BATCH_SIZE;
+    }
+
+    bool empty() const
+    {
+      return _pending.empty();
+    }
+
+    // calls the callback with the pending PES, then gives every one of them to
+    // release(pes_packet_impl_t &) to take its buffer back
+    template <typename F>
+    void flush(F &&release)
+    {
+      if (_pending.empty())
+      {
+        return;
+      }
+
+      _packets.clear();
+      for (const auto &pes_packet : _pending)
+      {
+        _packets.push_back(make_pes_packet(pes_packet));
+      }
+      std::stable_sort(begin(_packets), end(_packets),
+          [](const pes_packet_t &lhs, const pes_packet_t &rhs) { return lhs.pid < rhs.pid; });
+
+      try
+      {
+        _callback(pes_batch_t{_packets.data(), _packets.size()});
+      }
+      catch (...)
+      {
+        release_pending(release);
+        throw;
+      }
+      release_pending(release);
+    }
+
+  private:
+    const batch_received_callback_t &_callback;
+    std::vector<pes_packet_impl_t> _pending;
+    std::vector<pes_packet_t> _packets;
+
+    template <typename F>
+    void release_pending(F &release)
+    {
+      for (auto &pes_packet : _pending)
+      {
+        release(pes_packet);
+      }
+      _pending.clear();
+    }
+  };
+
+  // per-packet callback served through the batch interface
+  inline batch_received_callback_t make_batch_callback(packet_received_callback_t callback)
+  {
+    if (!callback)
+    {
+      return {};
+    }
+    return [callback = std::move(callback)](const pes_batch_t &batch) {
+      for (const auto &packet : batch)
+      {
+        callback(packet);
+      }
+    };
+  }
+
+} // namespace detail
+} // namespace mpegts
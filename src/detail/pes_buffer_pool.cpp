@@ -0,0 +1,108 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "pes_buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    constexpr size_t MIN_PES_BUFFER_CAPACITY = 4 * 1024;
+    // bounds memory held by idle buffers, roughly one buffer per active PID
+    constexpr size_t MAX_FREE_PES_BUFFERS = 64;
+  } // namespace
+
+  void pes_buffer::reserve(size_t capacity)
+  {
+    if (capacity <= _capacity)
+    {
+      return;
+    }
+
+    // default-initialized on purpose: the storage is always written before it is read
+    std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+    if (_size)
+    {
+      std::memcpy(data.get(), _data.get(), _size);
+    }
+    _data = std::move(data);
+    _capacity = capacity;
+  }
+
+  void pes_buffer::append(const uint8_t *data, size_t length)
+  {
+    if (_size + length > _capacity)
+    {
+      reserve(std::max({_size + length, _capacity * 2, MIN_PES_BUFFER_CAPACITY}));
+    }
+    std::memcpy(_data.get() + _size, data, length);
+    _size += length;
+  }
+
+  pes_buffer pes_buffer_pool::acquire(size_t size_hint)
+  {
+    // smallest free buffer that fits, otherwise the largest one which grows the least
+    auto best_it = end(_free_buffers);
+    for (auto it = begin(_free_buffers); it != end(_free_buffers); ++it)
+    {
+      if (best_it == end(_free_buffers))
+      {
+        best_it = it;
+        continue;
+      }
+
+      const bool fits = it->capacity() >= size_hint;
+      const bool best_fits = best_it->capacity() >= size_hint;
+      if ((fits && (!best_fits || it->capacity() < best_it->capacity())) ||
+          (!fits && !best_fits && it->capacity() > best_it->capacity()))
+      {
+        best_it = it;
+      }
+    }
+
+    pes_buffer buffer;
+    if (best_it != end(_free_buffers))
+    {
+      buffer = std::move(*best_it);
+      _free_buffers.erase(best_it);
+    }
+
+    buffer.reserve(std::max(size_hint, MIN_PES_BUFFER_CAPACITY));
+    return buffer;
+  }
+
+  void pes_buffer_pool::release(pes_buffer buffer)
+  {
+    if (!buffer.capacity() || _free_buffers.size() >= MAX_FREE_PES_BUFFERS)
+    {
+      return;
+    }
+    buffer.clear();
+    _free_buffers.push_back(std::move(buffer));
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,98 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // growable byte buffer which never zero-fills its storage
+  class pes_buffer
+  {
+  public:
+    pes_buffer() = default;
+    // moved-from buffer is left empty, so it can be handed back to the pool safely
+    pes_buffer(pes_buffer &&other) noexcept
+        : _data(std::move(other._data)), _size(std::exchange(other._size, 0)),
+          _capacity(std::exchange(other._capacity, 0))
+    {
+    }
+    pes_buffer &operator=(pes_buffer &&other) noexcept
+    {
+      _data = std::move(other._data);
+      _size = std::exchange(other._size, 0);
+      _capacity = std::exchange(other._capacity, 0);
+      return *this;
+    }
+
+    uint8_t *data()
+    {
+      return _data.get();
+    }
+    const uint8_t *data() const
+    {
+      return _data.get();
+    }
+    size_t size() const
+    {
+      return _size;
+    }
+    size_t capacity() const
+    {
+      return _capacity;
+    }
+
+    void clear()
+    {
+      _size = 0;
+    }
+
+    void reserve(size_t capacity);
+    void append(const uint8_t *data, size_t length);
+
+  private:
+    std::unique_ptr<uint8_t[]> _data;
+    size_t _size = 0;
+    size_t _capacity = 0;
+  };
+
+  // recycles PES buffers, so starting a new PES costs no allocation once the pool is warm
+  class pes_buffer_pool
+  {
+  public:
+    // returns an empty buffer with at least size_hint bytes of capacity
+    pes_buffer acquire(size_t size_hint);
+    void release(pes_buffer buffer);
+
+  private:
+    std::vector<pes_buffer> _free_buffers;
+  };
+
+} // namespace detail
+} // namespace mpegts
@@ -22,33 +22,327 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #pragma once
 
+#include "log_utils.h"
 #include "mpegts.h"
 #include "mpegts_detail.h"
+#include "parser_policies.h"
+#include "pid_table.h"
+#include "profiler.h"
+#include "stats_counters.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <boost/endian/conversion.hpp>
+#include <boost/log/trivial.hpp>
 
 namespace mpegts
 {
 namespace detail
 {
-  using pid_to_pes_packet_map_t = std::unordered_map<uint16_t, pes_packet_impl_t>;
 
-  // pes packets builder
-  class pes_parser
+  // called for every complete PES, it may take pes_packet.data and hand it back via recycle()
+  using pes_ready_callback_t = std::function<void(pes_packet_impl_t &)>;
+
+  // sets payload offset and length of a complete PES, false if it is malformed
+  bool finish_pes_packet(pes_packet_impl_t &pes_packet);
+
+  // whole PES including start code and PES_packet_length
+  inline uint64_t pes_packet_size(const pes_packet_impl_t &pes_packet)
+  {
+    return sizeof(uint32_t) + sizeof(uint16_t) + pes_packet.data.size();
+  }
+
+  // how many of length more bytes belong to pes_packet; PES_packet_length (max_length) is 0
+  // for unbounded video PES, otherwise the bytes after it in the TS packet are stuffing
+  inline size_t pes_bytes_to_take(const pes_packet_impl_t &pes_packet, size_t length)
+  {
+    if (!pes_packet.max_length)
+    {
+      return length;
+    }
+    return std::min(length, pes_packet.max_length - std::min(pes_packet.max_length,
+                                                        pes_packet.data.size()));
+  }
+
+  // a bounded PES is complete with its last byte, an unbounded one with the next PUSI
+  inline bool is_pes_complete(const pes_packet_impl_t &pes_packet)
+  {
+    return pes_packet.max_length && pes_packet.data.size() >= pes_packet.max_length;
+  }
+
+  // policy and sink independent part of pes_parser
+  class pes_parser_base
+  {
+  public:
+    // rate limited per PID
+    static void warn_pes_too_large(uint16_t pid);
+
+  protected:
+    static constexpr uint16_t NO_PES_SLOT = 0xffff;
+
+    static void warn_not_pusi();
+    static void warn_header_does_not_fit();
+  };
+
+  // pes packets builder; Sink is called as sink(pes_packet_impl_t &) like pes_ready_callback_t
+  // and Policy is one of parser_policies.h, so a concrete sink gets inlined into the parser
+  template <typename Sink = pes_ready_callback_t, typename Policy = dynamic_parser_policy>
+  class basic_pes_parser : public pes_parser_base
   {
   public:
-    explicit pes_parser(packet_received_callback_t callback);
+    explicit basic_pes_parser(Sink sink) : _sink(std::move(sink)), _buffer_pool(_own_buffer_pool)
+    {
+    }
+    // takes buffers from a pool which outlives the parser, so parsers run one after another
+    // on the same thread reuse them
+    basic_pes_parser(Sink sink, pes_buffer_pool &buffer_pool)
+        : _sink(std::move(sink)), _buffer_pool(buffer_pool)
+    {
+    }
+    ~basic_pes_parser()
+    {
+      for (auto &pes_packet : _pes_packets)
+      {
+        _buffer_pool.release(std::move(pes_packet.data));
+      }
+    }
+    basic_pes_parser(const basic_pes_parser &) = delete;
+    basic_pes_parser &operator=(const basic_pes_parser &) = delete;
+
+    void feed_ts_packet(const ts_packet_view &ts_packet, uint8_t stream_type)
+    {
+      profiling::scope<Policy::profile> timer(profiling::stage::pes_feed, ts_packet.pid);
+      pes_packet_impl_t *pes_packet = nullptr;
+      uint8_t pes_offset = ts_packet.pes_offset;
+
+      // start of PES packet
+      if (ts_packet.pusi)
+      {
+        pes_packet = handle_pusi_packet(ts_packet, stream_type, pes_offset);
+        if (!pes_packet)
+        {
+          return;
+        }
+      }
+      else
+      {
+        const uint16_t slot = _pes_slots[ts_packet.pid];
+
+        if (slot == NO_PES_SLOT)
+        {
+          // PUSI bit is 0, but there is no PES in progress for this PID, skipping
+          return;
+        }
+        pes_packet = &_pes_packets[slot];
+      }
+
+      const size_t ts_pes_length = pes_bytes_to_take(*pes_packet, TS_PACKET_DATA_SIZE - pes_offset);
+      auto &pes_data = pes_packet->data;
+
+      if (pes_data.size() + ts_pes_length > MAX_PES_SIZE)
+      {
+        warn_pes_too_large(ts_packet.pid);
+        drop_pes_packet(ts_packet.pid);
+        return;
+      }
+
+      // the only copy of TS payload on the way to the sink
+      pes_data.append(ts_packet.data + pes_offset, ts_pes_length);
+
+      // emitted right away instead of on the next PUSI, which may be a PES interval or, at
+      // the end of a live stream, forever away
+      if (is_pes_complete(*pes_packet))
+      {
+        complete_pes_packet(ts_packet.pid);
+      }
+    }
+
+    void flush()
+    {
+      for (size_t slot = 0; slot < _pes_packets.size(); ++slot)
+      {
+        auto &pes_packet = _pes_packets[slot];
+        // released slots keep the PID they were used for last
+        if (_pes_slots[pes_packet.ts_packet_pid] == slot)
+        {
+          handle_ready_pes_packet(pes_packet);
+        }
+      }
+    }
+
+    // hands out PES in progress as they are, instead of completing them as flush() does
+    std::vector<pes_packet_impl_t> take_pes_packets_in_progress()
+    {
+      std::vector<pes_packet_impl_t> pes_packets;
 
-    void feed_ts_packet(ts_packet_t ts_packet);
-    void flush();
+      for (size_t slot = 0; slot < _pes_packets.size(); ++slot)
+      {
+        auto &pes_packet = _pes_packets[slot];
+        uint16_t &pid_slot = _pes_slots[pes_packet.ts_packet_pid];
+        if (pid_slot == slot)
+        {
+          pes_packets.push_back(std::move(pes_packet));
+          _free_pes_slots.push_back(pid_slot);
+          pid_slot = NO_PES_SLOT;
+        }
+      }
+      return pes_packets;
+    }
+
+    // returns a buffer taken by the sink to the pool
+    void recycle(pes_buffer buffer)
+    {
+      _buffer_pool.release(std::move(buffer));
+    }
 
   private:
-    packet_received_callback_t _callback;
-    pid_to_pes_packet_map_t _pid_to_pes_packet;
+    Sink _sink;
+    // hot per-PID handle into _pes_packets, PES state itself is kept out of line
+    pid_table<uint16_t> _pes_slots{NO_PES_SLOT};
+    std::vector<pes_packet_impl_t> _pes_packets;
+    std::vector<uint16_t> _free_pes_slots;
+    pes_buffer_pool _own_buffer_pool;
+    pes_buffer_pool &_buffer_pool;
     uint64_t _pes_packet_num = 0;
 
-    pid_to_pes_packet_map_t::iterator handle_pusi_packet(ts_packet_t &ts_packet);
-    void handle_ready_pes_packet(pid_to_pes_packet_map_t::value_type &v);
+    static bool do_checks(const pes_packet_impl_t &pes_packet)
+    {
+      // expected start code is 00 00 01 <stream_id byte>, else it is not a PES packet;
+      // stream_id tells whether PES carries a media stream
+      return ((pes_packet.start_code >> 8) & 0x01) == 0x01 &&
+             Policy::stream_ids.accepts(pes_packet.stream_id);
+    }
+
+    pes_packet_impl_t *handle_pusi_packet(
+        const ts_packet_view &ts_packet, uint8_t stream_type, uint8_t &pes_offset)
+    {
+      if (!ts_packet.pusi)
+      {
+        warn_not_pusi();
+        return nullptr;
+      }
+
+      if (static_cast<size_t>(TS_PACKET_DATA_SIZE - pes_offset) <
+          sizeof(uint32_t) + sizeof(uint16_t))
+      {
+        warn_header_does_not_fit();
+        return nullptr;
+      }
+
+      pes_packet_impl_t pes_packet{};
+
+      pes_packet.ts_packet_pid = ts_packet.pid;
+      pes_packet.stream_type = stream_type;
+      pes_packet.start_code = boost::endian::big_to_native(
+          *reinterpret_cast<const uint32_t *>(&ts_packet.data[pes_offset]));
+      pes_packet.stream_id = (pes_packet.start_code & 0xff) | 0x100;
+
+      if (!do_checks(pes_packet))
+      {
+        if constexpr (Policy::stats)
+        {
+          if (auto *counters = stats::local())
+          {
+            counters->pid(pes_packet.ts_packet_pid).non_pes_skipped.add(1);
+          }
+        }
+        if (Policy::log_pes_packets())
+        {
+          log_utils::log_pes_packet(pes_packet, _pes_packet_num);
+        }
+        ++_pes_packet_num;
+        return nullptr;
+      }
+
+      pes_offset += sizeof(uint32_t);
+
+      pes_packet.max_length = boost::endian::big_to_native(
+          *reinterpret_cast<const uint16_t *>(&ts_packet.data[pes_offset]));
+      pes_offset += sizeof(uint16_t);
+
+      // PES_packet_length is 0 for unbounded video PES, expect it to be as large as the
+      // previous one
+      size_t size_hint = pes_packet.max_length;
+
+      uint16_t &slot = _pes_slots[ts_packet.pid];
+
+      if (slot != NO_PES_SLOT)
+      {
+        auto &prev_pes_packet = _pes_packets[slot];
+        if (!size_hint)
+        {
+          size_hint = prev_pes_packet.data.size();
+        }
+
+        // the sink may have taken the buffer, then there is nothing to release
+        handle_ready_pes_packet(prev_pes_packet);
+        _buffer_pool.release(std::move(prev_pes_packet.data));
+      }
+      else if (!_free_pes_slots.empty())
+      {
+        slot = _free_pes_slots.back();
+        _free_pes_slots.pop_back();
+      }
+      else
+      {
+        slot = static_cast<uint16_t>(_pes_packets.size());
+        _pes_packets.emplace_back();
+      }
+
+      pes_packet.data = _buffer_pool.acquire(size_hint);
+      _pes_packets[slot] = std::move(pes_packet);
+
+      return &_pes_packets[slot];
+    }
+
+    void handle_ready_pes_packet(pes_packet_impl_t &pes_packet)
+    {
+      profiling::scope<Policy::profile> timer(profiling::stage::pes_ready,
+                                              pes_packet.ts_packet_pid);
+      if (!finish_pes_packet(pes_packet))
+      {
+        return;
+      }
+
+      if (Policy::log_pes_packets())
+      {
+        log_utils::log_pes_packet(pes_packet, _pes_packet_num);
+      }
+      if constexpr (Policy::stats)
+      {
+        if (auto *counters = stats::local())
+        {
+          counters->add_pes(pes_packet.ts_packet_pid, pes_packet_size(pes_packet));
+        }
+      }
+
+      _sink(pes_packet);
+    }
+
+    void complete_pes_packet(uint16_t pid)
+    {
+      uint16_t &slot = _pes_slots[pid];
+
+      handle_ready_pes_packet(_pes_packets[slot]);
+      // the sink may have taken the buffer, then there is nothing to release
+      _buffer_pool.release(std::move(_pes_packets[slot].data));
+      _free_pes_slots.push_back(slot);
+      slot = NO_PES_SLOT;
+    }
+
+    void drop_pes_packet(uint16_t pid)
+    {
+      uint16_t &slot = _pes_slots[pid];
+
+      _buffer_pool.release(std::move(_pes_packets[slot].data));
+      _free_pes_slots.push_back(slot);
+      slot = NO_PES_SLOT;
+    }
   };
+
+  using pes_parser = basic_pes_parser<>;
+
 } // namespace detail
 } // namespace mpegts
@@ -0,0 +1,99 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "pid_table.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // 8192-bit PID membership bitmap, packets of PIDs not in it are dropped right after
+  // header decode and never reach parser state; PIDs are selected among elementary streams
+  // only, PSI PIDs always pass so programs and stream types are known whatever the selection
+  class pid_filter
+  {
+  public:
+    static constexpr size_t WORD_BITS = 32;
+    using bitmap_t = std::array<uint32_t, PID_COUNT / WORD_BITS>;
+
+    // accepts every PID unless allowed is not empty
+    pid_filter(const std::vector<uint16_t> &allowed, const std::vector<uint16_t> &excluded)
+    {
+      _selected.fill(allowed.empty() ? ~uint32_t{0} : 0);
+
+      for (auto pid : allowed)
+      {
+        _selected[word(pid)] |= bit(pid);
+      }
+      for (auto pid : excluded)
+      {
+        _selected[word(pid)] &= ~bit(pid);
+      }
+      _bitmap = _selected;
+    }
+
+    pid_filter() : pid_filter({}, {})
+    {
+    }
+
+    // replaces the PSI PIDs passed on top of the selected ones
+    void set_psi_pids(const std::vector<uint16_t> &psi_pids)
+    {
+      _bitmap = _selected;
+      for (auto pid : psi_pids)
+      {
+        _bitmap[word(pid)] |= bit(pid);
+      }
+    }
+
+    bool accepts(uint16_t pid) const
+    {
+      return _bitmap[word(pid)] & bit(pid);
+    }
+
+    const bitmap_t &bitmap() const
+    {
+      return _bitmap;
+    }
+
+  private:
+    bitmap_t _selected;
+    bitmap_t _bitmap;
+
+    static size_t word(uint16_t pid)
+    {
+      return (pid & (PID_COUNT - 1)) / WORD_BITS;
+    }
+    static uint32_t bit(uint16_t pid)
+    {
+      return uint32_t{1} << (pid % WORD_BITS);
+    }
+  };
+
+} // namespace detail
+} // namespace mpegts
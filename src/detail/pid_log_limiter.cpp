@@ -0,0 +1,70 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "pid_log_limiter.h"
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    int64_t now_ns()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+    }
+  } // namespace
+
+  pid_log_limiter::pid_log_limiter(std::chrono::milliseconds interval)
+      : _interval_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count())
+  {
+    const int64_t long_ago = now_ns() - _interval_ns;
+    for (size_t pid = 0; pid < PID_COUNT; ++pid)
+    {
+      _last_ns[pid].store(long_ago, std::memory_order_relaxed);
+      _suppressed[pid].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  bool pid_log_limiter::allow(uint16_t pid, uint64_t &suppressed)
+  {
+    pid &= PID_COUNT - 1;
+
+    const int64_t now = now_ns();
+    int64_t last = _last_ns[pid].load(std::memory_order_relaxed);
+
+    // of threads racing for the same interval only the one which moves it on logs
+    if (now - last < _interval_ns ||
+        !_last_ns[pid].compare_exchange_strong(last, now, std::memory_order_relaxed))
+    {
+      _suppressed[pid].fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    suppressed = _suppressed[pid].exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+} // namespace detail
+} // namespace mpegts
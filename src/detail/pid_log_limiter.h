@@ -0,0 +1,73 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "pid_table.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace mpegts
+{
+namespace detail
+{
+  // lets one message per PID through every interval and counts the ones held back in
+  // between, so a lossy feed costs a log record per PID and interval instead of one per
+  // packet; lock-free, a single limiter is shared by all threads logging the message
+  class pid_log_limiter
+  {
+  public:
+    explicit pid_log_limiter(std::chrono::milliseconds interval = std::chrono::seconds(1));
+    pid_log_limiter(const pid_log_limiter &) = delete;
+    pid_log_limiter &operator=(const pid_log_limiter &) = delete;
+
+    // true when a message about pid is to be logged, suppressed is then set to the number
+    // of messages about it held back since the previous one
+    bool allow(uint16_t pid, uint64_t &suppressed);
+
+  private:
+    const int64_t _interval_ns;
+    std::array<std::atomic<int64_t>, PID_COUNT> _last_ns;
+    std::array<std::atomic<uint64_t>, PID_COUNT> _suppressed;
+  };
+
+  // appended to a rate limited message
+  struct suppressed_messages
+  {
+    uint64_t count;
+  };
+
+  inline std::ostream &operator<<(std::ostream &os, suppressed_messages suppressed)
+  {
+    if (suppressed.count)
+    {
+      os << " (" << suppressed.count << " more since the last report)";
+    }
+    return os;
+  }
+
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,65 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace mpegts
+{
+namespace detail
+{
+  // PID is 13 bits wide, so per-PID state fits into a flat table indexed by PID
+  constexpr size_t PID_COUNT = 1 << 13;
+
+  // keep T small (a few bytes of hot state), larger state belongs out of line
+  template <typename T>
+  class pid_table
+  {
+  public:
+    explicit pid_table(T initial_value)
+    {
+      _entries.fill(initial_value);
+    }
+
+    T &operator[](uint16_t pid)
+    {
+      return _entries[pid & (PID_COUNT - 1)];
+    }
+    const T &operator[](uint16_t pid) const
+    {
+      return _entries[pid & (PID_COUNT - 1)];
+    }
+
+    bool operator==(const pid_table &other) const
+    {
+      return _entries == other._entries;
+    }
+
+  private:
+    std::array<T, PID_COUNT> _entries;
+  };
+
+} // namespace detail
+} // namespace mpegts
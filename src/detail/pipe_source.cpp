@@ -0,0 +1,128 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "pipe_source.h"
+#include "mpegts_detail.h"
+
+#include <system_error>
+
+#include <boost/thread.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    constexpr size_t PIPE_BLOCK_SIZE = TS_PACKET_SIZE * 1024;
+    // how often a thread waiting for input checks for interruption
+    constexpr int POLL_TIMEOUT_MS = 100;
+
+    const std::string STDIN_NAME = "-";
+
+    std::system_error make_error(int error, const std::string &what)
+    {
+      return std::system_error(error, std::generic_category(), what);
+    }
+  } // namespace
+
+  bool is_stream_input(const std::string &file_name)
+  {
+    if (file_name == STDIN_NAME)
+    {
+      return true;
+    }
+    struct stat status;
+    return ::stat(file_name.c_str(), &status) == 0 && !S_ISREG(status.st_mode) &&
+           !S_ISBLK(status.st_mode);
+  }
+
+  pipe_source::pipe_source(const std::string &file_name) : _buffer(PIPE_BLOCK_SIZE)
+  {
+    if (file_name == STDIN_NAME)
+    {
+      _fd = STDIN_FILENO;
+      return;
+    }
+
+    // opening a FIFO blocks until there is a writer, waiting happens in poll() instead
+    _fd = ::open(file_name.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (_fd < 0)
+    {
+      throw make_error(errno, "Failed to open " + file_name);
+    }
+    _owns_fd = true;
+
+    const int flags = ::fcntl(_fd, F_GETFL);
+    if (flags < 0 || ::fcntl(_fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+    {
+      const int error = errno;
+      ::close(_fd);
+      throw make_error(error, "Failed to set up " + file_name);
+    }
+  }
+
+  pipe_source::~pipe_source()
+  {
+    if (_owns_fd)
+    {
+      ::close(_fd);
+    }
+  }
+
+  buffer_slice pipe_source::read()
+  {
+    for (;;)
+    {
+      boost::this_thread::interruption_point();
+
+      pollfd fd{_fd, POLLIN, 0};
+      const int ready = ::poll(&fd, 1, POLL_TIMEOUT_MS);
+      if (ready < 0 && errno != EINTR)
+      {
+        throw make_error(errno, "poll");
+      }
+      if (ready <= 0)
+      {
+        continue;
+      }
+
+      // whatever is available, down to a single byte; packetizer joins the pieces
+      const ssize_t length = ::read(_fd, _buffer.data(), _buffer.size());
+      if (length < 0)
+      {
+        if (errno == EINTR || errno == EAGAIN)
+        {
+          continue;
+        }
+        throw make_error(errno, "read");
+      }
+      return buffer_slice{_buffer.data(), static_cast<size_t>(length)};
+    }
+  }
+} // namespace detail
+} // namespace mpegts
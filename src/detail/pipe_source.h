@@ -0,0 +1,56 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "input_source.h"
+
+#include <string>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // true for "-" (stdin), FIFOs and other inputs which can't be mapped or read ahead
+  bool is_stream_input(const std::string &file_name);
+
+  // reads stdin or a FIFO, handing out whatever has arrived without waiting for a full block,
+  // so packets are parsed as soon as they come; the input ends when the writer closes it
+  class pipe_source : public input_source
+  {
+  public:
+    explicit pipe_source(const std::string &file_name);
+    ~pipe_source() override;
+    pipe_source(const pipe_source &) = delete;
+    pipe_source &operator=(const pipe_source &) = delete;
+
+    // honours boost::thread interruption while waiting for input
+    buffer_slice read() override;
+
+  private:
+    int _fd = -1;
+    bool _owns_fd = false;
+    std::vector<uint8_t> _buffer;
+  };
+} // namespace detail
+} // namespace mpegts
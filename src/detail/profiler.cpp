@@ -0,0 +1,440 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "profiler.h"
+
+#ifdef MPEGTS_PROFILING
+#include "utils.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace profiling
+  {
+    namespace
+    {
+      constexpr const char *STAGE_NAMES[STAGE_COUNT] = {
+          "ts_parse", "pes_feed", "pes_ready", "sink"};
+      constexpr const char *EVENT_NAMES[perf_group::EVENT_COUNT] = {
+          "cycles", "instructions", "LLC misses", "branch misses"};
+      constexpr uint64_t EVENT_CONFIGS[perf_group::EVENT_COUNT] = {PERF_COUNT_HW_CPU_CYCLES,
+          PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+      std::atomic<bool> enabled{false};
+      std::atomic<bool> perf_warned{false};
+      uint64_t start_ticks = 0;
+      std::chrono::steady_clock::time_point start_time;
+
+      std::mutex profilers_mutex;
+      std::vector<std::unique_ptr<thread_profiler>> profilers;
+
+      long perf_event_open(perf_event_attr &attr, int group_fd)
+      {
+        // the calling thread on any CPU
+        return ::syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+      }
+
+      // counter value from the mmapped page of an event, see perf_event_open(2)
+      uint64_t read_mmapped(const perf_event_mmap_page *page)
+      {
+        uint64_t count = 0;
+        uint32_t seq = 0;
+
+        do
+        {
+          seq = page->lock;
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+
+          const uint32_t index = page->index;
+          count = page->offset;
+#if defined(__x86_64__)
+          if (page->cap_user_rdpmc && index)
+          {
+            const unsigned width = page->pmc_width;
+            int64_t pmc = static_cast<int64_t>(__builtin_ia32_rdpmc(index - 1));
+            pmc = static_cast<int64_t>(static_cast<uint64_t>(pmc) << (64 - width)) >> (64 - width);
+            count += static_cast<uint64_t>(pmc);
+          }
+#endif
+
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (page->lock != seq);
+
+        return count;
+      }
+
+      void write_ticks(std::ostream &os, uint64_t ticks, double ticks_per_ns)
+      {
+        os << std::setw(10) << static_cast<uint64_t>(ticks / ticks_per_ns);
+      }
+    } // namespace
+
+    void latency_histogram::merge(const latency_histogram &other)
+    {
+      for (size_t i = 0; i < BUCKET_COUNT; ++i)
+      {
+        _counts[i] += other._counts[i];
+      }
+      _count += other._count;
+      _total += other._total;
+      _max = std::max(_max, other._max);
+    }
+
+    uint64_t latency_histogram::lowest_of(size_t index)
+    {
+      if (index < 2 * HALF_BUCKET)
+      {
+        return index;
+      }
+      const size_t shift = index / HALF_BUCKET - 1;
+      return static_cast<uint64_t>(index - shift * HALF_BUCKET) << shift;
+    }
+
+    uint64_t latency_histogram::percentile(double fraction) const
+    {
+      const auto rank = static_cast<uint64_t>(fraction * _count);
+      uint64_t seen = 0;
+
+      for (size_t i = 0; i < BUCKET_COUNT; ++i)
+      {
+        seen += _counts[i];
+        if (seen > rank)
+        {
+          // middle of the bucket, never above the largest value recorded
+          return std::min(_max, (lowest_of(i) + lowest_of(i + 1)) / 2);
+        }
+      }
+      return _max;
+    }
+
+    perf_group::perf_group()
+    {
+      _fds.fill(-1);
+
+      for (size_t i = 0; i < EVENT_COUNT; ++i)
+      {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENT_CONFIGS[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        _fds[i] = static_cast<int>(perf_event_open(attr, i ? _fds[0] : -1));
+        if (_fds[i] < 0)
+        {
+          const int error = errno;
+          if (!perf_warned.exchange(true))
+          {
+            BOOST_LOG_TRIVIAL(warning) << "Hardware counters are unavailable, " << EVENT_NAMES[i]
+                                       << ": " << std::strerror(error);
+          }
+          for (size_t j = 0; j < i; ++j)
+          {
+            ::close(_fds[j]);
+          }
+          _fds.fill(-1);
+          return;
+        }
+      }
+
+      _cheap = true;
+      const long page_size = ::sysconf(_SC_PAGESIZE);
+      for (size_t i = 0; i < EVENT_COUNT; ++i)
+      {
+        void *page = ::mmap(nullptr, page_size, PROT_READ, MAP_SHARED, _fds[i], 0);
+        if (page == MAP_FAILED)
+        {
+          _cheap = false;
+          continue;
+        }
+        _pages[i] = page;
+        _cheap = _cheap && static_cast<const perf_event_mmap_page *>(page)->cap_user_rdpmc;
+      }
+    }
+
+    perf_group::~perf_group()
+    {
+      const long page_size = ::sysconf(_SC_PAGESIZE);
+      for (size_t i = 0; i < EVENT_COUNT; ++i)
+      {
+        if (_pages[i])
+        {
+          ::munmap(_pages[i], page_size);
+        }
+        if (_fds[i] >= 0)
+        {
+          ::close(_fds[i]);
+        }
+      }
+    }
+
+    void perf_group::read(values_t &values) const
+    {
+      if (_cheap)
+      {
+        for (size_t i = 0; i < EVENT_COUNT; ++i)
+        {
+          values[i] = read_mmapped(static_cast<const perf_event_mmap_page *>(_pages[i]));
+        }
+        return;
+      }
+
+      // PERF_FORMAT_GROUP: number of events followed by their values
+      uint64_t buffer[EVENT_COUNT + 1] = {};
+      if (::read(_fds[0], buffer, sizeof(buffer)) == static_cast<ssize_t>(sizeof(buffer)))
+      {
+        std::copy(buffer + 1, buffer + 1 + EVENT_COUNT, values.begin());
+      }
+    }
+
+    thread_profiler::thread_profiler()
+    {
+      pids.reserve(16);
+    }
+
+    void thread_profiler::enter(frame &frame, stage stage)
+    {
+      frame.parent = _top;
+      // without rdpmc only stages timed per run of packets afford reading the counters
+      frame.sample_events = _perf.is_open() &&
+                            (_perf.is_cheap() || stage == stage::ts_parse || stage == stage::sink);
+      if (frame.sample_events)
+      {
+        _perf.read(frame.events_start);
+      }
+      _top = &frame;
+      frame.start = read_ticks();
+    }
+
+    void thread_profiler::leave(frame &frame, stage stage, uint16_t pid)
+    {
+      const uint64_t ticks = read_ticks() - frame.start;
+      const uint64_t self_ticks = ticks - std::min(ticks, frame.children);
+      _top = frame.parent;
+
+      auto &profile = stages[static_cast<size_t>(stage)];
+      profile.ticks.record(self_ticks);
+      if (pid != NO_PID)
+      {
+        get_pid(pid).ticks[static_cast<size_t>(stage)].record(self_ticks);
+      }
+      if (frame.parent)
+      {
+        frame.parent->children += ticks;
+      }
+
+      if (frame.sample_events)
+      {
+        perf_group::values_t events;
+        _perf.read(events);
+        for (size_t i = 0; i < perf_group::EVENT_COUNT; ++i)
+        {
+          const uint64_t delta = events[i] - frame.events_start[i];
+          profile.events[i] += delta - std::min(delta, frame.children_events[i]);
+          if (frame.parent && frame.parent->sample_events)
+          {
+            frame.parent->children_events[i] += delta;
+          }
+        }
+        ++profile.event_samples;
+      }
+    }
+
+    thread_profiler::pid_profile &thread_profiler::get_pid(uint16_t pid)
+    {
+      uint16_t &index = _pid_index[pid];
+      if (index == NO_PID_INDEX)
+      {
+        index = static_cast<uint16_t>(pids.size());
+        pids.push_back(std::make_unique<pid_profile>());
+        pids.back()->pid = pid;
+      }
+      return *pids[index];
+    }
+
+    thread_profiler &local()
+    {
+      thread_local thread_profiler *profiler = nullptr;
+      if (!profiler)
+      {
+        std::lock_guard<std::mutex> lock(profilers_mutex);
+        profilers.push_back(std::make_unique<thread_profiler>());
+        profiler = profilers.back().get();
+      }
+      return *profiler;
+    }
+
+    void enable()
+    {
+      start_time = std::chrono::steady_clock::now();
+      start_ticks = read_ticks();
+      enabled = true;
+    }
+
+    bool is_enabled()
+    {
+      return enabled;
+    }
+
+    std::string report()
+    {
+      const double elapsed_ns = std::chrono::duration<double, std::nano>(
+          std::chrono::steady_clock::now() - start_time)
+                                    .count();
+      const double ticks_per_ns =
+          elapsed_ns > 0 ? std::max(1e-9, (read_ticks() - start_ticks) / elapsed_ns) : 1;
+
+      std::array<stage_profile, STAGE_COUNT> stages;
+      std::map<uint16_t, std::array<latency_histogram, STAGE_COUNT>> pids;
+      {
+        std::lock_guard<std::mutex> lock(profilers_mutex);
+        for (const auto &profiler : profilers)
+        {
+          for (size_t i = 0; i < STAGE_COUNT; ++i)
+          {
+            stages[i].ticks.merge(profiler->stages[i].ticks);
+            stages[i].event_samples += profiler->stages[i].event_samples;
+            for (size_t j = 0; j < perf_group::EVENT_COUNT; ++j)
+            {
+              stages[i].events[j] += profiler->stages[i].events[j];
+            }
+          }
+          for (const auto &pid : profiler->pids)
+          {
+            auto &histograms = pids[pid->pid];
+            for (size_t i = 0; i < STAGE_COUNT; ++i)
+            {
+              histograms[i].merge(pid->ticks[i]);
+            }
+          }
+        }
+      }
+
+      uint64_t total_ticks = 0;
+      for (const auto &stage : stages)
+      {
+        total_ticks += stage.ticks.total();
+      }
+
+      std::ostringstream os;
+      os << std::fixed << std::setprecision(1);
+      os << "Stage times without nested stages, " << std::setprecision(3) << ticks_per_ns
+         << " ticks/ns\n"
+         << std::setprecision(1);
+      os << std::left << std::setw(10) << "stage" << std::right << std::setw(12) << "calls"
+         << std::setw(12) << "total ms" << std::setw(8) << "share" << std::setw(10) << "p50 ns"
+         << std::setw(10) << "p90 ns" << std::setw(10) << "p99 ns" << std::setw(10) << "max ns"
+         << "\n";
+      for (size_t i = 0; i < STAGE_COUNT; ++i)
+      {
+        const auto &ticks = stages[i].ticks;
+        os << std::left << std::setw(10) << STAGE_NAMES[i] << std::right << std::setw(12)
+           << ticks.count() << std::setw(12) << ticks.total() / ticks_per_ns / 1e6
+           << std::setw(7) << (total_ticks ? 100.0 * ticks.total() / total_ticks : 0) << "%";
+        write_ticks(os, ticks.percentile(0.5), ticks_per_ns);
+        write_ticks(os, ticks.percentile(0.9), ticks_per_ns);
+        write_ticks(os, ticks.percentile(0.99), ticks_per_ns);
+        write_ticks(os, ticks.max(), ticks_per_ns);
+        os << "\n";
+      }
+
+      bool has_events = false;
+      for (const auto &stage : stages)
+      {
+        has_events = has_events || stage.event_samples;
+      }
+      if (has_events)
+      {
+        os << "\nHardware counters per call\n" << std::left << std::setw(10) << "stage";
+        for (const char *name : EVENT_NAMES)
+        {
+          os << std::right << std::setw(15) << name;
+        }
+        os << std::setw(8) << "IPC" << "\n";
+        for (size_t i = 0; i < STAGE_COUNT; ++i)
+        {
+          const auto &stage = stages[i];
+          if (!stage.event_samples)
+          {
+            continue;
+          }
+          os << std::left << std::setw(10) << STAGE_NAMES[i] << std::right;
+          for (auto value : stage.events)
+          {
+            os << std::setw(15) << static_cast<double>(value) / stage.event_samples;
+          }
+          os << std::setw(8) << std::setprecision(2)
+             << (stage.events[0] ? static_cast<double>(stage.events[1]) / stage.events[0] : 0)
+             << std::setprecision(1) << "\n";
+        }
+      }
+
+      os << "\nPer PID\n" << std::left << std::setw(8) << "PID" << std::setw(10) << "stage"
+         << std::right << std::setw(12) << "calls" << std::setw(12) << "total ms"
+         << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns" << std::setw(10) << "max ns"
+         << "\n";
+      for (const auto &pid : pids)
+      {
+        for (size_t i = 0; i < STAGE_COUNT; ++i)
+        {
+          const auto &ticks = pid.second[i];
+          if (!ticks.count())
+          {
+            continue;
+          }
+          os << std::left << std::setw(8) << utils::num_to_hex(pid.first, true) << std::setw(10)
+             << STAGE_NAMES[i] << std::right << std::setw(12) << ticks.count() << std::setw(12)
+             << ticks.total() / ticks_per_ns / 1e6;
+          write_ticks(os, ticks.percentile(0.5), ticks_per_ns);
+          write_ticks(os, ticks.percentile(0.99), ticks_per_ns);
+          write_ticks(os, ticks.max(), ticks_per_ns);
+          os << "\n";
+        }
+      }
+
+      return os.str();
+    }
+
+  } // namespace profiling
+} // namespace detail
+} // namespace mpegts
+#endif
@@ -0,0 +1,249 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef MPEGTS_PROFILING
+#include "pid_table.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#endif
+
+namespace mpegts
+{
+namespace detail
+{
+  // stage timers of profiled parser policies, built with MPEGTS_PROFILING only; every thread
+  // keeps its own latency histograms and hardware counters, a stage is timed without the
+  // stages nested in it
+  namespace profiling
+  {
+    enum class stage : uint8_t
+    {
+      // basic_ts_parser::parse() of a run of packets
+      ts_parse,
+      // basic_pes_parser::feed_ts_packet()
+      pes_feed,
+      // completing a PES and handing it to the batch
+      pes_ready,
+      // the batch callback
+      sink
+    };
+
+    constexpr size_t STAGE_COUNT = 4;
+    constexpr uint16_t NO_PID = 0xffff;
+
+    // times the enclosing block as stage of pid when Enabled, nothing otherwise
+    template <bool Enabled>
+    class scope
+    {
+    public:
+      explicit scope(stage, uint16_t = NO_PID)
+      {
+      }
+    };
+
+#ifdef MPEGTS_PROFILING
+    // log-linear histogram with 16 sub-buckets per power of 2, i.e. about 6% precision
+    // over the whole uint64_t range, as in HdrHistogram
+    class latency_histogram
+    {
+    public:
+      void record(uint64_t value)
+      {
+        ++_counts[index_of(value)];
+        ++_count;
+        _total += value;
+        _max = value > _max ? value : _max;
+      }
+
+      void merge(const latency_histogram &other);
+
+      // value below which the fraction of recorded values is
+      uint64_t percentile(double fraction) const;
+
+      uint64_t count() const
+      {
+        return _count;
+      }
+      uint64_t total() const
+      {
+        return _total;
+      }
+      uint64_t max() const
+      {
+        return _max;
+      }
+
+    private:
+      static constexpr unsigned PRECISION_BITS = 5;
+      static constexpr uint64_t HALF_BUCKET = uint64_t{1} << (PRECISION_BITS - 1);
+      static constexpr size_t BUCKET_COUNT = (66 - PRECISION_BITS) * HALF_BUCKET;
+
+      std::array<uint64_t, BUCKET_COUNT> _counts{};
+      uint64_t _count = 0;
+      uint64_t _total = 0;
+      uint64_t _max = 0;
+
+      static size_t index_of(uint64_t value)
+      {
+        if (value < 2 * HALF_BUCKET)
+        {
+          return static_cast<size_t>(value);
+        }
+        const unsigned shift = 63 - __builtin_clzll(value) - (PRECISION_BITS - 1);
+        return shift * HALF_BUCKET + static_cast<size_t>(value >> shift);
+      }
+
+      static uint64_t lowest_of(size_t index);
+    };
+
+    // cycles, instructions, LLC misses and branch misses of the calling thread as one
+    // perf_event_open() group; read with rdpmc when the kernel allows it
+    class perf_group
+    {
+    public:
+      static constexpr size_t EVENT_COUNT = 4;
+      using values_t = std::array<uint64_t, EVENT_COUNT>;
+
+      perf_group();
+      ~perf_group();
+      perf_group(const perf_group &) = delete;
+      perf_group &operator=(const perf_group &) = delete;
+
+      bool is_open() const
+      {
+        return _fds[0] >= 0;
+      }
+      // rdpmc takes tens of cycles, a read() system call microseconds
+      bool is_cheap() const
+      {
+        return _cheap;
+      }
+
+      void read(values_t &values) const;
+
+    private:
+      std::array<int, EVENT_COUNT> _fds;
+      std::array<void *, EVENT_COUNT> _pages{};
+      bool _cheap = false;
+    };
+
+    struct stage_profile
+    {
+      latency_histogram ticks;
+      // hardware counters over the stage, summed
+      perf_group::values_t events{};
+      uint64_t event_samples = 0;
+    };
+
+    // profile of one thread
+    class thread_profiler
+    {
+    public:
+      // a timed block, frames of nested blocks point to the enclosing one
+      struct frame
+      {
+        frame *parent;
+        uint64_t start;
+        uint64_t children = 0;
+        bool sample_events;
+        perf_group::values_t events_start;
+        perf_group::values_t children_events{};
+      };
+
+      thread_profiler();
+
+      void enter(frame &frame, stage stage);
+      void leave(frame &frame, stage stage, uint16_t pid);
+
+      std::array<stage_profile, STAGE_COUNT> stages;
+      // per-PID histograms of stages which have a PID
+      struct pid_profile
+      {
+        uint16_t pid;
+        std::array<latency_histogram, STAGE_COUNT> ticks;
+      };
+      std::vector<std::unique_ptr<pid_profile>> pids;
+
+    private:
+      static constexpr uint16_t NO_PID_INDEX = 0xffff;
+
+      frame *_top = nullptr;
+      perf_group _perf;
+      pid_table<uint16_t> _pid_index{NO_PID_INDEX};
+
+      pid_profile &get_pid(uint16_t pid);
+    };
+
+    // profiler of the calling thread, created on first use
+    thread_profiler &local();
+
+    inline uint64_t read_ticks()
+    {
+#if defined(__x86_64__)
+      return __builtin_ia32_rdtsc();
+#else
+      return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    template <>
+    class scope<true>
+    {
+    public:
+      explicit scope(stage stage, uint16_t pid = NO_PID)
+          : _profiler(local()), _stage(stage), _pid(pid)
+      {
+        _profiler.enter(_frame, _stage);
+      }
+      ~scope()
+      {
+        _profiler.leave(_frame, _stage, _pid);
+      }
+      scope(const scope &) = delete;
+      scope &operator=(const scope &) = delete;
+
+    private:
+      thread_profiler &_profiler;
+      const stage _stage;
+      const uint16_t _pid;
+      thread_profiler::frame _frame;
+    };
+
+    // demuxers created afterwards are profiled
+    void enable();
+    bool is_enabled();
+    // per-stage breakdown of all threads, to be taken once demuxing is done
+    std::string report();
+#endif
+
+  } // namespace profiling
+} // namespace detail
+} // namespace mpegts
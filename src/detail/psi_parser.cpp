@@ -0,0 +1,429 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "psi_parser.h"
+#include "crc32_mpeg2.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/log/trivial.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // https://en.wikipedia.org/wiki/Program-specific_information
+    constexpr uint8_t PAT_TABLE_ID = 0x00;
+    constexpr uint8_t PMT_TABLE_ID = 0x02;
+    constexpr uint8_t STUFFING_TABLE_ID = 0xff;
+
+    // table_id and the 2 bytes holding section_length
+    constexpr size_t SECTION_HEADER_SIZE = 3;
+    // header up to last_section_number and CRC_32
+    constexpr size_t MIN_SECTION_SIZE = 8 + sizeof(uint32_t);
+    // limit for PAT and PMT sections
+    constexpr size_t MAX_SECTION_LENGTH = 1021;
+
+    constexpr size_t PAT_ENTRY_SIZE = 4;
+    constexpr size_t PMT_HEADER_SIZE = 12;
+    constexpr size_t PMT_ENTRY_SIZE = 5;
+
+    uint16_t read_u16(const uint8_t *data)
+    {
+      return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    uint32_t read_u32(const uint8_t *data)
+    {
+      return (uint32_t{read_u16(data)} << 16) | read_u16(data + 2);
+    }
+
+    size_t get_section_length(const std::vector<uint8_t> &section)
+    {
+      return read_u16(&section[1]) & 0x0fff;
+    }
+
+    uint8_t get_version(const std::vector<uint8_t> &section)
+    {
+      return (section[5] >> 1) & 0x1f;
+    }
+  } // namespace
+
+  psi_parser::psi_parser()
+  {
+    add_psi_pid(PAT_PID);
+  }
+
+  void psi_parser::add_psi_pid(uint16_t pid)
+  {
+    uint16_t &slot = _psi_slots[pid];
+    if (slot != NO_PSI_SLOT)
+    {
+      return;
+    }
+
+    // a PMT PID dropped by an earlier PAT version starts over in its old state
+    auto state = std::find_if(_psi_states.begin(), _psi_states.end(),
+        [pid](const psi_state &state) { return state.pid == pid; });
+    if (state == _psi_states.end())
+    {
+      _psi_states.emplace_back();
+      state = std::prev(_psi_states.end());
+    }
+    *state = psi_state{};
+    state->pid = pid;
+    slot = static_cast<uint16_t>(state - _psi_states.begin());
+
+    if (pid != PAT_PID)
+    {
+      ++_unparsed_pmts;
+    }
+    _psi_pids_changed = true;
+  }
+
+  void psi_parser::remove_psi_pid(psi_state &state)
+  {
+    _psi_slots[state.pid] = NO_PSI_SLOT;
+    if (!state.has_table)
+    {
+      --_unparsed_pmts;
+    }
+    state.section.clear();
+    _psi_pids_changed = true;
+  }
+
+  void psi_parser::remove_stream(uint16_t pid)
+  {
+    BOOST_LOG_TRIVIAL(info) << "Program " << _programs[pid]
+                            << " stream PID removed: " << utils::num_to_hex(pid, true);
+    _stream_types[pid] = UNKNOWN_STREAM_TYPE;
+    _programs[pid] = NO_PROGRAM;
+  }
+
+  std::vector<uint16_t> psi_parser::psi_pids() const
+  {
+    std::vector<uint16_t> pids;
+    pids.reserve(_psi_states.size());
+    for (const auto &state : _psi_states)
+    {
+      if (is_psi_pid(state.pid))
+      {
+        pids.push_back(state.pid);
+      }
+    }
+    return pids;
+  }
+
+  bool psi_parser::is_equivalent(const psi_parser &other) const
+  {
+    const auto pids = psi_pids();
+    if (pids.size() != other.psi_pids().size())
+    {
+      return false;
+    }
+    for (auto pid : pids)
+    {
+      if (!other.is_psi_pid(pid) ||
+          _psi_states[_psi_slots[pid]].section != other._psi_states[other._psi_slots[pid]].section)
+      {
+        return false;
+      }
+    }
+
+    return _has_programs == other._has_programs && _stream_types == other._stream_types &&
+           _programs == other._programs;
+  }
+
+  bool psi_parser::feed_ts_packet(const ts_packet_view &ts_packet)
+  {
+    _psi_pids_changed = false;
+    collect_ts_packet(ts_packet);
+    return _psi_pids_changed;
+  }
+
+  void psi_parser::collect_ts_packet(const ts_packet_view &ts_packet)
+  {
+    const uint16_t slot = _psi_slots[ts_packet.pid];
+    if (slot == NO_PSI_SLOT)
+    {
+      return;
+    }
+
+    auto &state = _psi_states[slot];
+    const uint8_t *data = ts_packet.data + ts_packet.pes_offset;
+    size_t length = TS_PACKET_DATA_SIZE - ts_packet.pes_offset;
+
+    if (!ts_packet.pusi)
+    {
+      // continuation of the section in progress, if any
+      if (!state.section.empty())
+      {
+        collect_section(state, data, length, false);
+      }
+      return;
+    }
+
+    if (!length)
+    {
+      return;
+    }
+
+    const size_t pointer_field = data[0];
+    ++data;
+    --length;
+
+    if (pointer_field > length)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "PSI pointer_field is past the end of TS packet, PID: "
+                                 << utils::num_to_hex(ts_packet.pid, true);
+      state.section.clear();
+      return;
+    }
+
+    // bytes before the new section finish the one in progress
+    if (!state.section.empty())
+    {
+      collect_section(state, data, pointer_field, false);
+      if (!state.section.empty())
+      {
+        BOOST_LOG_TRIVIAL(debug) << "PSI section is incomplete, skipping, PID: "
+                                 << utils::num_to_hex(ts_packet.pid, true);
+        state.section.clear();
+      }
+    }
+
+    collect_section(state, data + pointer_field, length - pointer_field, true);
+  }
+
+  void psi_parser::collect_section(
+      psi_state &state, const uint8_t *data, size_t length, bool pusi)
+  {
+    auto &section = state.section;
+
+    while (length)
+    {
+      // only a PUSI packet may start sections, the rest of it after them is stuffing
+      if (section.empty() && (!pusi || data[0] == STUFFING_TABLE_ID))
+      {
+        return;
+      }
+
+      const size_t section_size = section.size() < SECTION_HEADER_SIZE
+                                      ? SECTION_HEADER_SIZE
+                                      : SECTION_HEADER_SIZE + get_section_length(section);
+      const size_t count = std::min(section_size - section.size(), length);
+
+      section.insert(section.end(), data, data + count);
+      data += count;
+      length -= count;
+
+      if (section.size() < SECTION_HEADER_SIZE)
+      {
+        continue;
+      }
+      if (get_section_length(section) > MAX_SECTION_LENGTH)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "PSI section_length is invalid, skipping, PID: "
+                                   << utils::num_to_hex(state.pid, true);
+        section.clear();
+        return;
+      }
+      if (section.size() == SECTION_HEADER_SIZE + get_section_length(section))
+      {
+        handle_section(state);
+        section.clear();
+      }
+    }
+  }
+
+  bool psi_parser::is_repeated_section(const psi_state &state) const
+  {
+    const auto &section = state.section;
+
+    // the CRC already in the section stands in for its content, so a repeated table costs
+    // a few compares instead of CRC validation and parsing
+    return state.has_last_section && state.last_table_id == section[0] &&
+           state.last_version == get_version(section) &&
+           state.last_section_number == section[6] &&
+           state.last_crc == read_u32(&section[section.size() - sizeof(uint32_t)]);
+  }
+
+  void psi_parser::handle_section(psi_state &state)
+  {
+    const auto &section = state.section;
+
+    if (section.size() < MIN_SECTION_SIZE)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "PSI section is too short, skipping, PID: "
+                                 << utils::num_to_hex(state.pid, true);
+      return;
+    }
+
+    // section_syntax_indicator is set for PAT and PMT, current_next_indicator is 0 for a
+    // table which is not valid yet
+    if (!(section[1] & 0x80) || !(section[5] & 0x01))
+    {
+      return;
+    }
+
+    if (is_repeated_section(state))
+    {
+      return;
+    }
+
+    if (crc32_mpeg2::compute(section.data(), section.size()))
+    {
+      BOOST_LOG_TRIVIAL(warning) << "PSI section CRC mismatch, skipping, PID: "
+                                 << utils::num_to_hex(state.pid, true);
+      return;
+    }
+
+    const bool new_version = !state.has_last_section || state.last_version != get_version(section);
+
+    state.has_last_section = true;
+    state.last_table_id = section[0];
+    state.last_version = get_version(section);
+    state.last_section_number = section[6];
+    state.last_crc = read_u32(&section[section.size() - sizeof(uint32_t)]);
+
+    if (state.pid == PAT_PID && section[0] == PAT_TABLE_ID)
+    {
+      handle_pat_section(section, new_version);
+      _has_pat = true;
+    }
+    else if (state.pid != PAT_PID && section[0] == PMT_TABLE_ID)
+    {
+      handle_pmt_section(section, new_version);
+      if (!state.has_table)
+      {
+        state.has_table = true;
+        --_unparsed_pmts;
+      }
+    }
+  }
+
+  void psi_parser::handle_pat_section(const std::vector<uint8_t> &section, bool new_version)
+  {
+    const size_t end = section.size() - sizeof(uint32_t);
+
+    std::vector<uint16_t> program_numbers;
+    std::vector<uint16_t> pmt_pids;
+    for (size_t pos = 8; pos + PAT_ENTRY_SIZE <= end; pos += PAT_ENTRY_SIZE)
+    {
+      const uint16_t program_number = read_u16(&section[pos]);
+      const uint16_t pid = read_u16(&section[pos + 2]) & 0x1fff;
+
+      // program 0 points to the network PID
+      if (program_number)
+      {
+        program_numbers.push_back(program_number);
+        pmt_pids.push_back(pid);
+      }
+    }
+
+    // a new version of a PAT sent in one section replaces the programs of the old one, PMT
+    // PIDs and streams of programs it no longer lists are dropped
+    if (new_version && !section[7])
+    {
+      auto lists = [](const std::vector<uint16_t> &values, uint16_t value) {
+        return std::find(values.begin(), values.end(), value) != values.end();
+      };
+
+      for (auto &state : _psi_states)
+      {
+        if (state.pid != PAT_PID && is_psi_pid(state.pid) && !lists(pmt_pids, state.pid))
+        {
+          BOOST_LOG_TRIVIAL(info) << "PMT PID removed: " << utils::num_to_hex(state.pid, true);
+          remove_psi_pid(state);
+        }
+      }
+      for (uint16_t pid = 0; pid < PID_COUNT; ++pid)
+      {
+        if (_programs[pid] != NO_PROGRAM && !lists(program_numbers, _programs[pid]))
+        {
+          remove_stream(pid);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < pmt_pids.size(); ++i)
+    {
+      if (!is_psi_pid(pmt_pids[i]))
+      {
+        BOOST_LOG_TRIVIAL(info) << "Program " << program_numbers[i]
+                                << " PMT PID: " << utils::num_to_hex(pmt_pids[i], true);
+        add_psi_pid(pmt_pids[i]);
+      }
+    }
+  }
+
+  void psi_parser::handle_pmt_section(const std::vector<uint8_t> &section, bool new_version)
+  {
+    const uint16_t program_number = read_u16(&section[3]);
+    const size_t end = section.size() - sizeof(uint32_t);
+
+    std::vector<uint16_t> stream_pids;
+
+    size_t pos = PMT_HEADER_SIZE + (read_u16(&section[10]) & 0x0fff);
+
+    while (pos + PMT_ENTRY_SIZE <= end)
+    {
+      const uint8_t stream_type = section[pos];
+      const uint16_t pid = read_u16(&section[pos + 1]) & 0x1fff;
+      const size_t es_info_length = read_u16(&section[pos + 3]) & 0x0fff;
+      stream_pids.push_back(pid);
+
+      if (_stream_types[pid] != stream_type || _programs[pid] != program_number)
+      {
+        BOOST_LOG_TRIVIAL(info) << "Program " << program_number
+                                << " stream PID: " << utils::num_to_hex(pid, true)
+                                << ", stream_type: "
+                                << utils::num_to_hex(unsigned{stream_type}, true);
+        _stream_types[pid] = stream_type;
+        _programs[pid] = program_number;
+      }
+
+      pos += PMT_ENTRY_SIZE + es_info_length;
+    }
+
+    // a new version replaces the streams of the program, the ones it no longer lists are
+    // no longer media
+    if (new_version)
+    {
+      for (uint16_t pid = 0; pid < PID_COUNT; ++pid)
+      {
+        if (_programs[pid] == program_number &&
+            std::find(stream_pids.begin(), stream_pids.end(), pid) == stream_pids.end())
+        {
+          remove_stream(pid);
+        }
+      }
+    }
+
+    _has_programs = true;
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,123 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "mpegts_detail.h"
+#include "pid_table.h"
+
+#include <deque>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // PAT/PMT sections builder, maps elementary stream PIDs to their program and stream_type
+  class psi_parser
+  {
+  public:
+    static constexpr uint16_t PAT_PID = 0x0000;
+    static constexpr uint8_t UNKNOWN_STREAM_TYPE = 0x00;
+    static constexpr uint16_t NO_PROGRAM = 0xffff;
+
+    psi_parser();
+
+    // PAT PID and every PMT PID announced by the current PAT
+    bool is_psi_pid(uint16_t pid) const
+    {
+      return _psi_slots[pid] != NO_PSI_SLOT;
+    }
+    // true once at least one PMT has been parsed, PIDs it doesn't list aren't media streams
+    bool has_programs() const
+    {
+      return _has_programs;
+    }
+    // true once PAT and PMT of every program it lists have been parsed
+    bool has_all_programs() const
+    {
+      return _has_pat && !_unparsed_pmts;
+    }
+    // false for PIDs which aren't elementary streams of any known program
+    bool is_media_pid(uint16_t pid) const
+    {
+      return !_has_programs || _stream_types[pid] != UNKNOWN_STREAM_TYPE;
+    }
+    uint8_t get_stream_type(uint16_t pid) const
+    {
+      return _stream_types[pid];
+    }
+    uint16_t get_program_number(uint16_t pid) const
+    {
+      return _programs[pid];
+    }
+
+    // PAT PID and the PMT PIDs it currently announces
+    std::vector<uint16_t> psi_pids() const;
+
+    // true when both select and name PIDs the same way and continue the same sections, so
+    // the same packets parsed from either give the same output
+    bool is_equivalent(const psi_parser &other) const;
+
+    // returns true when the packet changed psi_pids()
+    bool feed_ts_packet(const ts_packet_view &ts_packet);
+
+  private:
+    static constexpr uint16_t NO_PSI_SLOT = 0xffff;
+
+    // section being reassembled on a PSI PID plus the header of the last accepted one,
+    // a repeated section with the same version and CRC is dropped before CRC validation
+    struct psi_state
+    {
+      uint16_t pid;
+      std::vector<uint8_t> section;
+      bool has_table = false;
+      bool has_last_section = false;
+      uint8_t last_table_id = 0;
+      uint8_t last_version = 0;
+      uint8_t last_section_number = 0;
+      uint32_t last_crc = 0;
+    };
+
+    pid_table<uint16_t> _psi_slots{NO_PSI_SLOT};
+    // a deque, so the state of the PAT being handled stays put while PMT PIDs are added
+    std::deque<psi_state> _psi_states;
+    pid_table<uint8_t> _stream_types{UNKNOWN_STREAM_TYPE};
+    pid_table<uint16_t> _programs{NO_PROGRAM};
+    bool _has_programs = false;
+    bool _has_pat = false;
+    size_t _unparsed_pmts = 0;
+    bool _psi_pids_changed = false;
+
+    void add_psi_pid(uint16_t pid);
+    void remove_psi_pid(psi_state &state);
+    void remove_stream(uint16_t pid);
+    void collect_ts_packet(const ts_packet_view &ts_packet);
+    void collect_section(psi_state &state, const uint8_t *data, size_t length, bool pusi);
+    bool is_repeated_section(const psi_state &state) const;
+    void handle_section(psi_state &state);
+    void handle_pat_section(const std::vector<uint8_t> &section, bool new_version);
+    void handle_pmt_section(const std::vector<uint8_t> &section, bool new_version);
+  };
+
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,168 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace mpegts
+{
+namespace detail
+{
+  // single producer single consumer lock-free ring, capacity is rounded up to a power of 2;
+  // each side caches the other side's index and touches the shared one only when the cached
+  // value says the ring is full or empty
+  template <typename T>
+  class spsc_ring
+  {
+  public:
+    explicit spsc_ring(size_t capacity) : _slots(round_up_pow2(capacity)), _mask(_slots.size() - 1)
+    {
+    }
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    // producer side, fill(T &) writes the value right into the free slot
+    template <typename F>
+    bool try_push_with(F &&fill)
+    {
+      const size_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail - _cached_head == _slots.size())
+      {
+        _cached_head = _head.load(std::memory_order_acquire);
+        if (tail - _cached_head == _slots.size())
+        {
+          return false;
+        }
+      }
+      fill(_slots[tail & _mask]);
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_push(T &&value)
+    {
+      return try_push_with([&value](T &slot) { slot = std::move(value); });
+    }
+
+    // producer side, waits for the consumer to free a slot
+    template <typename F>
+    void push_with(F &&fill)
+    {
+      for (unsigned spins = 0; !try_push_with(fill); ++spins)
+      {
+        backoff(spins);
+      }
+    }
+
+    void push(T &&value)
+    {
+      push_with([&value](T &slot) { slot = std::move(value); });
+    }
+
+    // producer side, nothing is pushed after it
+    void close()
+    {
+      _closed.store(true, std::memory_order_release);
+    }
+
+    // consumer side, consume(T &) reads the value in place before the slot is freed
+    template <typename F>
+    bool try_consume(F &&consume)
+    {
+      const size_t head = _head.load(std::memory_order_relaxed);
+      if (head == _cached_tail)
+      {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+        if (head == _cached_tail)
+        {
+          return false;
+        }
+      }
+      consume(_slots[head & _mask]);
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T &value)
+    {
+      return try_consume([&value](T &slot) { value = std::move(slot); });
+    }
+
+    // consumer side, true once the producer closed the ring; check it before the last
+    // try_pop to know nothing is left behind
+    bool is_closed() const
+    {
+      return _closed.load(std::memory_order_acquire);
+    }
+
+    // spins briefly, then gives the CPU away so an oversubscribed pipeline still progresses
+    static void backoff(unsigned spins)
+    {
+      if (spins < SPINS_BEFORE_YIELD)
+      {
+#if defined(__x86_64__)
+        _mm_pause();
+#endif
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+
+  private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr unsigned SPINS_BEFORE_YIELD = 64;
+
+    static size_t round_up_pow2(size_t value)
+    {
+      size_t result = 1;
+      while (result < value)
+      {
+        result <<= 1;
+      }
+      return result;
+    }
+
+    std::vector<T> _slots;
+    const size_t _mask;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head{0};
+    size_t _cached_tail = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail{0};
+    size_t _cached_head = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> _closed{false};
+  };
+
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,129 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "stats_counters.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace stats
+  {
+    std::atomic<bool> enabled_flag{false};
+
+    namespace
+    {
+      std::mutex threads_mutex;
+      std::vector<std::unique_ptr<thread_counters>> threads;
+      // counts of the threads which exited, so memory doesn't grow with every thread pool
+      thread_counters retired;
+    } // namespace
+
+    thread_registration::~thread_registration()
+    {
+      exited = true;
+      if (!counters)
+      {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(threads_mutex);
+      retired.merge(*counters);
+      threads.erase(std::find_if(threads.begin(), threads.end(),
+          [this](const auto &thread) { return thread.get() == counters; }));
+      counters = nullptr;
+    }
+
+    thread_counters::thread_counters()
+    {
+      for (auto &pid : _pids)
+      {
+        pid.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    pid_counters &thread_counters::add_pid(uint16_t pid)
+    {
+      _pid_storage.push_back(std::make_unique<pid_counters>());
+      pid_counters &counters = *_pid_storage.back();
+      // snapshots read the table while the owning thread fills it
+      _pids[pid & (PID_COUNT - 1)].store(&counters, std::memory_order_release);
+      return counters;
+    }
+
+    void thread_counters::merge(const thread_counters &other)
+    {
+      packets.add(other.packets.get());
+      skipped_bytes.add(other.skipped_bytes.get());
+
+      for (uint16_t pid = 0; pid < PID_COUNT; ++pid)
+      {
+        const pid_counters *from = other.find_pid(pid);
+        if (!from)
+        {
+          continue;
+        }
+
+        pid_counters &to = this->pid(pid);
+        to.packets.add(from->packets.get());
+        to.pes_packets.add(from->pes_packets.get());
+        to.pes_bytes.add(from->pes_bytes.get());
+        to.max_pes_size.raise_to(from->max_pes_size.get());
+        to.cc_errors.add(from->cc_errors.get());
+        to.tei_drops.add(from->tei_drops.get());
+        to.non_pes_skipped.add(from->non_pes_skipped.get());
+      }
+    }
+
+    void enable()
+    {
+      enabled_flag.store(true, std::memory_order_relaxed);
+    }
+
+    bool is_enabled()
+    {
+      return enabled_flag.load(std::memory_order_relaxed);
+    }
+
+    thread_counters *register_thread()
+    {
+      std::lock_guard<std::mutex> lock(threads_mutex);
+      threads.push_back(std::make_unique<thread_counters>());
+      return threads.back().get();
+    }
+
+    void for_each_thread(const std::function<void(const thread_counters &)> &f)
+    {
+      std::lock_guard<std::mutex> lock(threads_mutex);
+      for (const auto &counters : threads)
+      {
+        f(*counters);
+      }
+      f(retired);
+    }
+
+  } // namespace stats
+} // namespace detail
+} // namespace mpegts
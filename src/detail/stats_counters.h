@@ -0,0 +1,167 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "pid_table.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace stats
+  {
+    constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // written by the thread owning it only, read by snapshots on any thread; a relaxed load
+    // and store cost the writer as much as a plain increment
+    class counter
+    {
+    public:
+      void add(uint64_t value)
+      {
+        _value.store(_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      }
+
+      void raise_to(uint64_t value)
+      {
+        if (value > _value.load(std::memory_order_relaxed))
+        {
+          _value.store(value, std::memory_order_relaxed);
+        }
+      }
+
+      uint64_t get() const
+      {
+        return _value.load(std::memory_order_relaxed);
+      }
+
+    private:
+      std::atomic<uint64_t> _value{0};
+    };
+
+    // counters of a PID on one thread, a cache line of its own
+    struct alignas(CACHE_LINE_SIZE) pid_counters
+    {
+      counter packets;
+      counter pes_packets;
+      counter pes_bytes;
+      counter max_pes_size;
+      // continuity counter errors
+      counter cc_errors;
+      // packets with transport_error_indicator set
+      counter tei_drops;
+      // PES skipped for a stream_id which doesn't carry media
+      counter non_pes_skipped;
+    };
+
+    // counters of one thread, PID counters are allocated on the first event of the PID
+    class thread_counters
+    {
+    public:
+      thread_counters();
+      thread_counters(const thread_counters &) = delete;
+      thread_counters &operator=(const thread_counters &) = delete;
+
+      pid_counters &pid(uint16_t pid)
+      {
+        pid_counters *counters = _pids[pid & (PID_COUNT - 1)].load(std::memory_order_relaxed);
+        return counters ? *counters : add_pid(pid);
+      }
+
+      // nullptr when the thread saw nothing of the PID yet
+      const pid_counters *find_pid(uint16_t pid) const
+      {
+        return _pids[pid & (PID_COUNT - 1)].load(std::memory_order_acquire);
+      }
+
+      void add_pes(uint16_t pid, uint64_t size)
+      {
+        pid_counters &counters = this->pid(pid);
+        counters.pes_packets.add(1);
+        counters.pes_bytes.add(size);
+        counters.max_pes_size.raise_to(size);
+      }
+
+      // adds the counts of other, a thread which no longer writes them
+      void merge(const thread_counters &other);
+
+      // every TS packet parsed, valid or not
+      alignas(CACHE_LINE_SIZE) counter packets;
+      // input bytes dropped to find TS packet alignment
+      counter skipped_bytes;
+
+    private:
+      std::array<std::atomic<pid_counters *>, PID_COUNT> _pids;
+      std::vector<std::unique_ptr<pid_counters>> _pid_storage;
+
+      pid_counters &add_pid(uint16_t pid);
+    };
+
+    // counting is off until enabled, it can't be turned off afterwards
+    void enable();
+    bool is_enabled();
+
+    // used by local()
+    extern std::atomic<bool> enabled_flag;
+    thread_counters *register_thread();
+
+    // counters of a thread; on exit its counts are merged into those of retired threads and
+    // the counters are freed, nothing is counted on the thread afterwards
+    struct thread_registration
+    {
+      thread_counters *counters = nullptr;
+      bool exited = false;
+
+      ~thread_registration();
+    };
+
+    // counters of the calling thread, nullptr while counting is off and once the thread
+    // is exiting
+    inline thread_counters *local()
+    {
+      if (!enabled_flag.load(std::memory_order_relaxed))
+      {
+        return nullptr;
+      }
+      thread_local thread_registration registration;
+      if (!registration.counters && !registration.exited)
+      {
+        registration.counters = register_thread();
+      }
+      return registration.counters;
+    }
+
+    // calls f for the counters of every running thread which counted anything and for the
+    // merged counters of the retired ones, new and exiting threads wait
+    void for_each_thread(const std::function<void(const thread_counters &)> &f);
+
+  } // namespace stats
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,51 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "stream_source.h"
+#include "mpegts_detail.h"
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    constexpr size_t STREAM_BLOCK_SIZE = TS_PACKET_SIZE * 1024;
+  }
+
+  stream_source::stream_source(const std::string &file_name) : _buffer(STREAM_BLOCK_SIZE)
+  {
+    _ifs.exceptions(_ifs.exceptions() | std::ios::badbit);
+    _ifs.open(file_name, std::ios::in | std::ios::binary);
+    if (!_ifs)
+    {
+      throw std::ios_base::failure("Failed to open " + file_name);
+    }
+  }
+
+  buffer_slice stream_source::read()
+  {
+    _ifs.read(reinterpret_cast<char *>(_buffer.data()), _buffer.size());
+    return buffer_slice{_buffer.data(), static_cast<size_t>(_ifs.gcount())};
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,151 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "sync_scanner.h"
+#include "mpegts_detail.h"
+
+#if defined(__x86_64__)
+#define MPEGTS_SYNC_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace sync_scanner
+  {
+    namespace
+    {
+      constexpr uint8_t SYNC_BYTE = 0x47;
+
+      bool is_synced_at(const uint8_t *data, size_t depth)
+      {
+        for (size_t i = 0; i < depth; ++i)
+        {
+          if (data[i * TS_PACKET_SIZE] != SYNC_BYTE)
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      size_t find_sync_scalar(const uint8_t *data, size_t offset, size_t limit, size_t depth)
+      {
+        for (; offset < limit; ++offset)
+        {
+          if (is_synced_at(data + offset, depth))
+          {
+            return offset;
+          }
+        }
+        return npos;
+      }
+
+#ifdef MPEGTS_SYNC_SCANNER_X86
+      // both kernels test a vector of candidate offsets at once: lane i of the mask is set
+      // when every byte at offset + i + k * TS_PACKET_SIZE, k < depth, is a sync byte
+
+      __attribute__((target("avx2"))) size_t find_sync_avx2(
+          const uint8_t *data, size_t limit, size_t depth)
+      {
+        const __m256i sync = _mm256_set1_epi8(static_cast<char>(SYNC_BYTE));
+
+        size_t offset = 0;
+        for (; offset + sizeof(__m256i) <= limit; offset += sizeof(__m256i))
+        {
+          const uint8_t *p = data + offset;
+          __m256i matches =
+              _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), sync);
+
+          for (size_t k = 1; k < depth && !_mm256_testz_si256(matches, matches); ++k)
+          {
+            p += TS_PACKET_SIZE;
+            matches = _mm256_and_si256(matches,
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), sync));
+          }
+
+          if (const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches)))
+          {
+            return offset + __builtin_ctz(mask);
+          }
+        }
+
+        return find_sync_scalar(data, offset, limit, depth);
+      }
+
+      size_t find_sync_sse2(const uint8_t *data, size_t limit, size_t depth)
+      {
+        const __m128i sync = _mm_set1_epi8(static_cast<char>(SYNC_BYTE));
+
+        size_t offset = 0;
+        for (; offset + sizeof(__m128i) <= limit; offset += sizeof(__m128i))
+        {
+          const uint8_t *p = data + offset;
+          __m128i matches =
+              _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), sync);
+          int mask = _mm_movemask_epi8(matches);
+
+          for (size_t k = 1; k < depth && mask; ++k)
+          {
+            p += TS_PACKET_SIZE;
+            matches = _mm_and_si128(matches,
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), sync));
+            mask = _mm_movemask_epi8(matches);
+          }
+
+          if (mask)
+          {
+            return offset + __builtin_ctz(static_cast<unsigned>(mask));
+          }
+        }
+
+        return find_sync_scalar(data, offset, limit, depth);
+      }
+
+      const bool has_avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+      }();
+#endif
+    } // namespace
+
+    size_t scan_limit(size_t length, size_t depth)
+    {
+      const size_t window = (depth - 1) * TS_PACKET_SIZE;
+      return length > window ? length - window : 0;
+    }
+
+    size_t find_sync(const uint8_t *data, size_t length, size_t depth)
+    {
+      const size_t limit = scan_limit(length, depth);
+
+#ifdef MPEGTS_SYNC_SCANNER_X86
+      return has_avx2 ? find_sync_avx2(data, limit, depth) : find_sync_sse2(data, limit, depth);
+#else
+      return find_sync_scalar(data, 0, limit, depth);
+#endif
+    }
+  } // namespace sync_scanner
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,48 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace sync_scanner
+  {
+    constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    // number of leading offsets in a buffer of given length which can be tested for
+    // depth consecutive sync bytes
+    size_t scan_limit(size_t length, size_t depth);
+
+    // returns the first offset below scan_limit(length, depth) at which depth consecutive
+    // bytes at TS packet stride are all sync bytes, npos if there is none;
+    // uses AVX2 or SSE2 when the CPU supports it
+    size_t find_sync(const uint8_t *data, size_t length, size_t depth);
+  } // namespace sync_scanner
+
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,58 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "thread_affinity.h"
+
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <boost/log/trivial.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  void pin_current_thread(int cpu)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "CPU " << cpu << " is out of range, thread is not pinned";
+      return;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result)
+    {
+      BOOST_LOG_TRIVIAL(warning)
+          << "Failed to pin thread to CPU " << cpu << ": " << strerror(result);
+      return;
+    }
+    BOOST_LOG_TRIVIAL(debug) << "Thread is pinned to CPU " << cpu;
+  }
+} // namespace detail
+} // namespace mpegts
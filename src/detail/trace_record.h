@@ -0,0 +1,91 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace trace
+  {
+    // binary packet trace file: trace_file_header followed by trace_record entries, both in
+    // host byte order; mpeg-ts-trace-decode renders it as JSON
+    constexpr char TRACE_MAGIC[8] = {'M', 'P', 'T', 'S', 'T', 'R', 'C', '\0'};
+    constexpr uint32_t TRACE_VERSION = 1;
+
+    struct trace_file_header
+    {
+      char magic[8];
+      uint32_t version;
+      uint32_t record_size;
+    };
+
+    enum class record_type : uint8_t
+    {
+      ts_packet = 1,
+      pes_packet = 2
+    };
+
+    // trace_record::flags
+    constexpr uint8_t TRANSPORT_ERROR_FLAG = 0x01;
+    constexpr uint8_t PUSI_FLAG = 0x02;
+
+    // one TS packet or PES, fields unused by the record type are zero
+    struct trace_record
+    {
+      // since the trace was started
+      uint64_t timestamp_ns;
+      // packet number within its parser
+      uint64_t number;
+
+      // TS packet
+      uint32_t header;
+      // PES
+      uint32_t cur_length;
+      uint32_t payload_length;
+
+      uint16_t pid;
+      // index of the thread in order of its first record
+      uint16_t thread;
+      // PES
+      uint16_t stream_id;
+      uint16_t max_length;
+      uint16_t payload_offset;
+
+      record_type type;
+      // TS packet
+      uint8_t continuity_cnt;
+      uint8_t adaptation_field_ctl;
+      uint8_t pes_offset;
+      uint8_t flags;
+
+      uint8_t reserved[5];
+    };
+
+    static_assert(sizeof(trace_record) == 48, "trace_record is a file format");
+
+  } // namespace trace
+} // namespace detail
+} // namespace mpegts
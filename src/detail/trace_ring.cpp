@@ -0,0 +1,283 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "trace_ring.h"
+#include "spsc_ring.h"
+
+#include <boost/log/trivial.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace trace
+  {
+    namespace
+    {
+      constexpr auto DUMP_INTERVAL = std::chrono::milliseconds(10);
+      constexpr size_t DUMP_BATCH_SIZE = 4096;
+
+      struct thread_ring
+      {
+        thread_ring(size_t ring_size, uint16_t index) : records(ring_size), thread(index)
+        {
+        }
+
+        spsc_ring<trace_record> records;
+        const uint16_t thread;
+        std::atomic<uint64_t> dropped{0};
+      };
+
+      class collector
+      {
+      public:
+        ~collector()
+        {
+          stop();
+        }
+
+        void start(const std::string &file_name, size_t ring_size)
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+
+          if (_thread.joinable())
+          {
+            throw std::logic_error("packet trace is already running");
+          }
+
+          const int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+          if (fd < 0)
+          {
+            throw std::runtime_error(
+                "can't create trace file " + file_name + ": " + std::strerror(errno));
+          }
+
+          _fd = fd;
+          _failed = false;
+          _written = 0;
+          _ring_size = ring_size;
+          _rings.clear();
+          _start_time = std::chrono::steady_clock::now();
+          _stopping = false;
+
+          trace_file_header header{};
+          std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+          header.version = TRACE_VERSION;
+          header.record_size = sizeof(trace_record);
+          write_all(&header, sizeof(header));
+
+          ++_generation;
+          _thread = std::thread([this]() { run(); });
+          active.store(true, std::memory_order_release);
+        }
+
+        void stop()
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+
+          if (!_thread.joinable())
+          {
+            return;
+          }
+
+          active.store(false, std::memory_order_release);
+          _stopping = true;
+          lock.unlock();
+          _wakeup.notify_one();
+          _thread.join();
+          lock.lock();
+
+          uint64_t dropped = 0;
+          for (const auto &ring : _rings)
+          {
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+          }
+          ::close(_fd);
+          _fd = -1;
+
+          BOOST_LOG_TRIVIAL(info) << "Packet trace: " << _written << " records from "
+                                  << _rings.size() << " threads";
+          if (dropped)
+          {
+            BOOST_LOG_TRIVIAL(warning)
+                << "Packet trace: " << dropped << " records dropped, trace rings were full";
+          }
+        }
+
+        // ring of the calling thread, registered on its first record
+        thread_ring *get_ring()
+        {
+          thread_local std::shared_ptr<thread_ring> ring;
+          thread_local uint64_t generation = 0;
+
+          if (generation != _generation.load(std::memory_order_acquire))
+          {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ring = std::make_shared<thread_ring>(_ring_size, static_cast<uint16_t>(_rings.size()));
+            _rings.push_back(ring);
+            generation = _generation;
+          }
+          return ring.get();
+        }
+
+        std::chrono::steady_clock::time_point start_time() const
+        {
+          return _start_time;
+        }
+
+        std::atomic<bool> active{false};
+
+      private:
+        // guards everything but the trace file, which is used by the background thread only
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        std::vector<std::shared_ptr<thread_ring>> _rings;
+        size_t _ring_size = 0;
+        std::atomic<uint64_t> _generation{0};
+        std::chrono::steady_clock::time_point _start_time;
+        bool _stopping = false;
+        std::thread _thread;
+
+        int _fd = -1;
+        bool _failed = false;
+        uint64_t _written = 0;
+
+        void run()
+        {
+          std::vector<trace_record> buffer;
+          buffer.reserve(DUMP_BATCH_SIZE);
+          std::vector<std::shared_ptr<thread_ring>> rings;
+
+          for (bool stopping = false; !stopping;)
+          {
+            {
+              std::unique_lock<std::mutex> lock(_mutex);
+              _wakeup.wait_for(lock, DUMP_INTERVAL, [this]() { return _stopping; });
+              // the last pass drains what was written before the trace became inactive
+              stopping = _stopping;
+              rings = _rings;
+            }
+
+            for (const auto &ring : rings)
+            {
+              while (ring->records.try_consume(
+                  [&buffer](trace_record &record) { buffer.push_back(record); }))
+              {
+                if (buffer.size() == DUMP_BATCH_SIZE)
+                {
+                  dump(buffer);
+                }
+              }
+            }
+            dump(buffer);
+          }
+        }
+
+        void dump(std::vector<trace_record> &buffer)
+        {
+          if (!buffer.empty() && !_failed)
+          {
+            write_all(buffer.data(), buffer.size() * sizeof(trace_record));
+            _written += buffer.size();
+          }
+          buffer.clear();
+        }
+
+        void write_all(const void *data, size_t length)
+        {
+          auto *bytes = static_cast<const uint8_t *>(data);
+
+          while (length)
+          {
+            const ssize_t written = ::write(_fd, bytes, length);
+            if (written < 0)
+            {
+              if (errno == EINTR)
+              {
+                continue;
+              }
+              BOOST_LOG_TRIVIAL(error)
+                  << "Packet trace write failed, tracing stopped: " << std::strerror(errno);
+              _failed = true;
+              return;
+            }
+            bytes += written;
+            length -= written;
+          }
+        }
+      };
+
+      collector g_collector;
+    } // namespace
+
+    void start(const std::string &file_name, size_t ring_size)
+    {
+      g_collector.start(file_name, ring_size);
+    }
+
+    void stop()
+    {
+      g_collector.stop();
+    }
+
+    bool is_active()
+    {
+      return g_collector.active.load(std::memory_order_acquire);
+    }
+
+    void write(trace_record &record)
+    {
+      if (!g_collector.active.load(std::memory_order_acquire))
+      {
+        return;
+      }
+
+      thread_ring *ring = g_collector.get_ring();
+
+      record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - g_collector.start_time())
+                                .count();
+      record.thread = ring->thread;
+
+      if (!ring->records.try_push_with([&record](trace_record &slot) { slot = record; }))
+      {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+  } // namespace trace
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,52 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "trace_record.h"
+
+#include <cstddef>
+#include <string>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace trace
+  {
+    // packet trace collector: every thread writes trace records into its own lock-free ring
+    // and a background thread dumps the rings to the trace file; a record which does not fit
+    // into a full ring is dropped and counted, writing never blocks
+
+    // starts the background thread, ring_size is in records per thread; throws when the file
+    // can't be created or the trace is already running
+    void start(const std::string &file_name, size_t ring_size);
+    // dumps what is left and closes the file, records written afterwards are ignored
+    void stop();
+    bool is_active();
+
+    // timestamp_ns and thread are set here
+    void write(trace_record &record);
+
+  } // namespace trace
+} // namespace detail
+} // namespace mpegts
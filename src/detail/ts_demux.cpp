@@ -0,0 +1,205 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "ts_demux.h"
+#include "demux_pipeline.h"
+#include "parser_policies.h"
+#include "pes_batcher.h"
+#include "pes_parser.h"
+#include "profiler.h"
+#include "psi_parser.h"
+#include "stats_counters.h"
+#include "ts_packetizer.h"
+#include "ts_parser.h"
+
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    template <typename Policy>
+    class demux_engine : public ts_demux_engine
+    {
+    public:
+      demux_engine(const demux_settings &settings, const batch_received_callback_t &callback,
+          pes_buffer_pool &buffer_pool)
+          : _ts_parser(pid_filter(settings.pids, settings.exclude_pids)), _batcher(callback)
+      {
+        _ts_parser.set_psi_pids(_psi_parser.psi_pids());
+        if (settings.workers)
+        {
+          _pipeline = std::make_unique<demux_pipeline>(settings, callback);
+        }
+        else
+        {
+          _pes_parser = std::make_unique<pes_parser_t>(batch_sink{this}, buffer_pool);
+        }
+      }
+
+      void push(const uint8_t *data, size_t length) override
+      {
+        _packetizer.push(data, length,
+            [this](const uint8_t *first, size_t count) { on_packets(first, count); });
+        count_skipped_bytes();
+        flush_batch();
+      }
+
+      void finish() override
+      {
+        _packetizer.flush(
+            [this](const uint8_t *first, size_t count) { on_packets(first, count); });
+        count_skipped_bytes();
+
+        BOOST_LOG_TRIVIAL(trace) << "Flushing...";
+        if (_pipeline)
+        {
+          _pipeline->finish();
+        }
+        else
+        {
+          _pes_parser->flush();
+          flush_batch();
+        }
+      }
+
+      uint64_t skipped_bytes() const override
+      {
+        return _packetizer.skipped_bytes();
+      }
+
+    private:
+      // adds complete PES to the batch, a call the compiler can see through unlike
+      // pes_ready_callback_t
+      struct batch_sink
+      {
+        demux_engine *engine;
+
+        void operator()(pes_packet_impl_t &pes_packet) const
+        {
+          if (engine->_batcher.add(pes_packet))
+          {
+            engine->flush_batch();
+          }
+        }
+      };
+
+      using pes_parser_t = basic_pes_parser<batch_sink, Policy>;
+
+      ts_packetizer _packetizer;
+      basic_ts_parser<Policy> _ts_parser;
+      psi_parser _psi_parser;
+      // PES are either reassembled by _pes_parser or by pipeline workers
+      std::unique_ptr<pes_parser_t> _pes_parser;
+      std::unique_ptr<demux_pipeline> _pipeline;
+      pes_batcher _batcher;
+      uint64_t _counted_skipped_bytes = 0;
+
+      void count_skipped_bytes()
+      {
+        const uint64_t skipped_bytes = _packetizer.skipped_bytes();
+        if (skipped_bytes != _counted_skipped_bytes)
+        {
+          if (auto *counters = stats::local())
+          {
+            counters->skipped_bytes.add(skipped_bytes - _counted_skipped_bytes);
+          }
+          _counted_skipped_bytes = skipped_bytes;
+        }
+      }
+
+      void flush_batch()
+      {
+        if (_pes_parser && !_batcher.empty())
+        {
+          profiling::scope<Policy::profile> timer(profiling::stage::sink);
+          _batcher.flush([this](pes_packet_impl_t &pes_packet) {
+            _pes_parser->recycle(std::move(pes_packet.data));
+          });
+        }
+      }
+
+      void on_packets(const uint8_t *first, size_t count)
+      {
+        boost::this_thread::interruption_point();
+
+        // header and payload are read in place from the input block
+        _ts_parser.parse(first, count, [this](const ts_packet_view &ts_packet) {
+          if (_psi_parser.is_psi_pid(ts_packet.pid))
+          {
+            if (_psi_parser.feed_ts_packet(ts_packet))
+            {
+              _ts_parser.set_psi_pids(_psi_parser.psi_pids());
+            }
+            return;
+          }
+          if (!_psi_parser.is_media_pid(ts_packet.pid))
+          {
+            // not an elementary stream of any program
+            return;
+          }
+
+          const uint8_t stream_type = _psi_parser.get_stream_type(ts_packet.pid);
+          if (_pipeline)
+          {
+            _pipeline->push(ts_packet, stream_type);
+          }
+          else
+          {
+            _pes_parser->feed_ts_packet(ts_packet, stream_type);
+          }
+        });
+      }
+    };
+
+    // engine on Policy, with every stage timed while profiling
+    template <typename Policy>
+    std::unique_ptr<ts_demux_engine> make_engine(const demux_settings &settings,
+        const batch_received_callback_t &callback, pes_buffer_pool &buffer_pool)
+    {
+#ifdef MPEGTS_PROFILING
+      if (profiling::is_enabled())
+      {
+        return std::make_unique<demux_engine<profiled<Policy>>>(settings, callback, buffer_pool);
+      }
+#endif
+      return std::make_unique<demux_engine<Policy>>(settings, callback, buffer_pool);
+    }
+  } // namespace
+
+  ts_demux::ts_demux(const demux_settings &settings, const batch_received_callback_t &callback,
+      pes_buffer_pool &buffer_pool)
+  {
+    if (is_quiet_logging())
+    {
+      _engine = make_engine<quiet_parser_policy>(settings, callback, buffer_pool);
+    }
+    else
+    {
+      _engine = make_engine<dynamic_parser_policy>(settings, callback, buffer_pool);
+    }
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,82 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "demux_service.h"
+#include "mpegts.h"
+#include "pes_buffer_pool.h"
+
+#include <memory>
+
+namespace mpegts
+{
+namespace detail
+{
+  // packet path of ts_demux, specialised on a parser policy
+  class ts_demux_engine
+  {
+  public:
+    virtual ~ts_demux_engine() = default;
+
+    virtual void push(const uint8_t *data, size_t length) = 0;
+    virtual void finish() = 0;
+    virtual uint64_t skipped_bytes() const = 0;
+  };
+
+  // demuxes one TS input pushed chunk by chunk: PSI is tracked, elementary streams of the
+  // programs are reassembled into PES right here or by a pipeline when settings.workers is
+  // set; PES completed in a chunk are delivered as one batch at its end;
+  // settings.pids and settings.exclude_pids filter the PIDs, other settings are unused;
+  // the packet path is compiled without any logging when packet dumps and trace logging are
+  // off at construction
+  class ts_demux
+  {
+  public:
+    ts_demux(const demux_settings &settings, const batch_received_callback_t &callback,
+        pes_buffer_pool &buffer_pool);
+    ts_demux(const ts_demux &) = delete;
+    ts_demux &operator=(const ts_demux &) = delete;
+
+    // chunk of any size and alignment, partial packets are kept for the next one;
+    // honours boost::thread interruption
+    void push(const uint8_t *data, size_t length)
+    {
+      _engine->push(data, length);
+    }
+    // end of input, emits PES in progress; nothing can be pushed afterwards
+    void finish()
+    {
+      _engine->finish();
+    }
+
+    uint64_t skipped_bytes() const
+    {
+      return _engine->skipped_bytes();
+    }
+
+  private:
+    std::unique_ptr<ts_demux_engine> _engine;
+  };
+
+} // namespace detail
+} // namespace mpegts
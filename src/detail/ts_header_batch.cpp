@@ -0,0 +1,205 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "ts_header_batch.h"
+#include "mpegts_detail.h"
+
+#include <cstring>
+
+#include <boost/endian/conversion.hpp>
+
+#if defined(__x86_64__)
+#define MPEGTS_HEADER_BATCH_X86
+#include <immintrin.h>
+#endif
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // https://en.wikipedia.org/wiki/MPEG_transport_stream#Important_elements_of_a_transport_stream
+    constexpr uint32_t SYNC_BYTE = 0x47;
+    constexpr uint32_t TRANSPORT_ERROR_BIT = 0x800000;
+    constexpr uint32_t PUSI_BIT = 0x400000;
+    constexpr uint32_t PAYLOAD_BIT = 0x10;
+
+    bool is_pid_accepted(uint16_t pid)
+    {
+      // PAT, tables or PES range
+      return pid == 0x0000 || (pid >= 0x20 && pid <= 0x1FFA) || (pid >= 0x1FFC && pid <= 0x1FFE);
+    }
+
+    void decode_scalar(const uint8_t *first, size_t lane, size_t count, const pid_filter &filter,
+        ts_header_batch &batch)
+    {
+      for (; lane < count; ++lane)
+      {
+        uint32_t header;
+        std::memcpy(&header, first + lane * TS_PACKET_SIZE, sizeof(header));
+        header = boost::endian::big_to_native(header);
+
+        const uint64_t bit = uint64_t{1} << lane;
+        const uint16_t pid = (header & 0x1fff00) >> 8;
+
+        const bool sync = (header >> 24) == SYNC_BYTE;
+        const bool transport_error = header & TRANSPORT_ERROR_BIT;
+        const bool payload = header & PAYLOAD_BIT;
+        const bool selected = filter.accepts(pid);
+
+        batch.sync_mask |= sync ? bit : 0;
+        batch.transport_error_mask |= transport_error ? bit : 0;
+        batch.pusi_mask |= (header & PUSI_BIT) ? bit : 0;
+        batch.payload_mask |= payload ? bit : 0;
+        batch.selected_mask |= selected ? bit : 0;
+        const bool valid = sync && !transport_error && payload && is_pid_accepted(pid);
+        batch.valid_mask |= (valid && selected) ? bit : 0;
+        batch.filtered_mask |= (valid && !selected) ? bit : 0;
+
+        batch.pid[lane] = pid;
+        batch.continuity_cnt[lane] = header & 0xf;
+        batch.adaptation_field_ctl[lane] = (header & 0x30) >> 4;
+      }
+    }
+
+#ifdef MPEGTS_HEADER_BATCH_X86
+#define MPEGTS_AVX2 __attribute__((target("avx2")))
+
+    MPEGTS_AVX2 inline __m256i set1(uint32_t v)
+    {
+      return _mm256_set1_epi32(static_cast<int>(v));
+    }
+
+    MPEGTS_AVX2 inline __m256i has_bit(__m256i v, __m256i bit)
+    {
+      return _mm256_cmpeq_epi32(_mm256_and_si256(v, bit), bit);
+    }
+
+    MPEGTS_AVX2 inline uint64_t to_mask(__m256i v)
+    {
+      return static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(v)));
+    }
+
+    // narrows 8 x 32 bit lanes to 8 x 16 bit in the low half
+    MPEGTS_AVX2 inline __m128i pack_u16(__m256i v)
+    {
+      return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08));
+    }
+
+    // narrows 8 x 32 bit lanes to 8 x 8 bit in the low quarter
+    MPEGTS_AVX2 inline __m128i pack_u8(__m256i v)
+    {
+      const __m128i v16 = pack_u16(v);
+      return _mm_packus_epi16(v16, v16);
+    }
+
+    // 8 packets per step: headers are gathered at packet stride, byte-swapped, and every
+    // field is extracted for all lanes with the same masks and shifts as the scalar path;
+    // PID filter bits are gathered from the bitmap words by PID
+    MPEGTS_AVX2 size_t decode_avx2(
+        const uint8_t *first, size_t count, const pid_filter &filter, ts_header_batch &batch)
+    {
+      const auto *bitmap = reinterpret_cast<const int *>(filter.bitmap().data());
+
+      constexpr int P = TS_PACKET_SIZE;
+      const __m256i offsets = _mm256_setr_epi32(0, P, 2 * P, 3 * P, 4 * P, 5 * P, 6 * P, 7 * P);
+      const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13,
+          12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+      size_t lane = 0;
+      for (; lane + 8 <= count; lane += 8)
+      {
+        const auto *base = reinterpret_cast<const int *>(first + lane * TS_PACKET_SIZE);
+        const __m256i header =
+            _mm256_shuffle_epi8(_mm256_i32gather_epi32(base, offsets, 1), bswap);
+
+        const __m256i pid = _mm256_and_si256(_mm256_srli_epi32(header, 8), set1(0x1fff));
+        const __m256i sync = _mm256_cmpeq_epi32(_mm256_srli_epi32(header, 24), set1(SYNC_BYTE));
+        const __m256i transport_error = has_bit(header, set1(TRANSPORT_ERROR_BIT));
+        const __m256i payload = has_bit(header, set1(PAYLOAD_BIT));
+
+        const __m256i filter_words = _mm256_i32gather_epi32(
+            bitmap, _mm256_srli_epi32(pid, 5), sizeof(pid_filter::bitmap_t::value_type));
+        const __m256i selected = has_bit(
+            _mm256_srlv_epi32(filter_words, _mm256_and_si256(pid, set1(0x1f))), set1(0x1));
+
+        const __m256i pes_range = _mm256_and_si256(
+            _mm256_cmpgt_epi32(pid, set1(0x1F)), _mm256_cmpgt_epi32(set1(0x1FFB), pid));
+        const __m256i tables_range = _mm256_or_si256(_mm256_cmpeq_epi32(pid, set1(0x0000)),
+            _mm256_and_si256(
+                _mm256_cmpgt_epi32(pid, set1(0x1FFB)), _mm256_cmpgt_epi32(set1(0x1FFF), pid)));
+
+        const __m256i valid = _mm256_andnot_si256(transport_error,
+            _mm256_and_si256(_mm256_and_si256(sync, payload),
+                _mm256_or_si256(pes_range, tables_range)));
+
+        batch.sync_mask |= to_mask(sync) << lane;
+        batch.transport_error_mask |= to_mask(transport_error) << lane;
+        batch.pusi_mask |= to_mask(has_bit(header, set1(PUSI_BIT))) << lane;
+        batch.payload_mask |= to_mask(payload) << lane;
+        batch.selected_mask |= to_mask(selected) << lane;
+        batch.valid_mask |= to_mask(_mm256_and_si256(valid, selected)) << lane;
+        batch.filtered_mask |= to_mask(_mm256_andnot_si256(selected, valid)) << lane;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&batch.pid[lane]), pack_u16(pid));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&batch.continuity_cnt[lane]),
+            pack_u8(_mm256_and_si256(header, set1(0xf))));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&batch.adaptation_field_ctl[lane]),
+            pack_u8(_mm256_and_si256(_mm256_srli_epi32(header, 4), set1(0x3))));
+      }
+
+      return lane;
+    }
+
+    const bool has_avx2 = [] {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+    }();
+
+#undef MPEGTS_AVX2
+#endif
+  } // namespace
+
+  void decode_ts_headers(
+      const uint8_t *first, size_t count, const pid_filter &filter, ts_header_batch &batch)
+  {
+    batch.count = count;
+    batch.sync_mask = 0;
+    batch.transport_error_mask = 0;
+    batch.pusi_mask = 0;
+    batch.payload_mask = 0;
+    batch.selected_mask = 0;
+    batch.valid_mask = 0;
+    batch.filtered_mask = 0;
+
+    size_t lane = 0;
+#ifdef MPEGTS_HEADER_BATCH_X86
+    if (has_avx2)
+    {
+      lane = decode_avx2(first, count, filter, batch);
+    }
+#endif
+    decode_scalar(first, lane, count, filter, batch);
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,67 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "pid_filter.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace mpegts
+{
+namespace detail
+{
+  constexpr size_t TS_HEADER_BATCH_SIZE = 64;
+
+  // headers of consecutive TS packets decoded in one pass, laid out as structure of arrays;
+  // bit i of every mask and entry i of every array describe packet i
+  struct ts_header_batch
+  {
+    size_t count;
+
+    uint64_t sync_mask;
+    uint64_t transport_error_mask;
+    uint64_t pusi_mask;
+    // adaptation_field_ctl is 01 or 11
+    uint64_t payload_mask;
+    // PID is accepted by the PID filter
+    uint64_t selected_mask;
+    // valid sync byte, no transport error, has payload, PID is PAT, in tables or PES range
+    // and is selected
+    uint64_t valid_mask;
+    // valid but for the PID filter
+    uint64_t filtered_mask;
+
+    std::array<uint16_t, TS_HEADER_BATCH_SIZE> pid;
+    std::array<uint8_t, TS_HEADER_BATCH_SIZE> continuity_cnt;
+    std::array<uint8_t, TS_HEADER_BATCH_SIZE> adaptation_field_ctl;
+  };
+
+  // decodes headers of up to TS_HEADER_BATCH_SIZE packets stored back to back at first;
+  // uses AVX2 when the CPU supports it
+  void decode_ts_headers(
+      const uint8_t *first, size_t count, const pid_filter &filter, ts_header_batch &batch);
+
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,56 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "ts_packetizer.h"
+
+#include <boost/log/trivial.hpp>
+
+namespace mpegts
+{
+namespace detail
+{
+  void ts_packetizer::lose_sync()
+  {
+    BOOST_LOG_TRIVIAL(warning) << "TS sync byte is missing, resynchronizing";
+    _synced = false;
+  }
+
+  void ts_packetizer::acquire_sync()
+  {
+    if (_skipped_since_sync)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "TS packet alignment found after skipping "
+                                 << _skipped_since_sync << " bytes";
+    }
+    _synced = true;
+    _skipped_since_sync = 0;
+  }
+
+  void ts_packetizer::drop_carry()
+  {
+    BOOST_LOG_TRIVIAL(warning) << "Truncated TS packet at the end of input (" << _carry.size()
+                               << " bytes), skipping";
+    skip(_carry.size());
+    _carry.clear();
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,261 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "mpegts_detail.h"
+#include "sync_scanner.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // splits input chunks of any size and alignment into runs of contiguous TS packets;
+  // finds packet alignment at start of input and after corruption
+  class ts_packetizer
+  {
+  public:
+    // consecutive sync bytes at packet stride required to (re)acquire alignment
+    static constexpr size_t SYNC_DEPTH = 5;
+
+    ts_packetizer()
+    {
+      _carry.reserve(CARRY_CAPACITY);
+    }
+
+    // calls on_packets(const uint8_t *first, size_t count) for every run of aligned packets;
+    // packets are read in place except for the few straddling chunk boundaries
+    template <typename F>
+    void push(const uint8_t *data, size_t length, F &&on_packets)
+    {
+      uint64_t data_offset = _input_length;
+      _input_length += length;
+
+      while (!_carry.empty() && length)
+      {
+        const size_t carried = _carry.size();
+        const size_t taken = std::min(length, CARRY_CAPACITY - carried);
+        _carry.insert(end(_carry), data, data + taken);
+
+        const size_t consumed =
+            process(_carry.data(), _carry.size(), _carry_offset, false, on_packets);
+
+        if (consumed >= carried)
+        {
+          // carried bytes are used up, the rest is handled in place
+          data += consumed - carried;
+          data_offset += consumed - carried;
+          length -= consumed - carried;
+          _carry.clear();
+        }
+        else if (consumed)
+        {
+          // give taken bytes back and retry with what is left of the carry
+          _carry.erase(begin(_carry), begin(_carry) + consumed);
+          _carry.resize(carried - consumed);
+          _carry_offset += consumed;
+        }
+        else
+        {
+          // not enough input to make progress yet, a full carry always makes progress
+          data += taken;
+          data_offset += taken;
+          length -= taken;
+        }
+      }
+
+      const size_t consumed = process(data, length, data_offset, false, on_packets);
+      if (_carry.empty())
+      {
+        _carry_offset = data_offset + consumed;
+      }
+      _carry.insert(end(_carry), data + consumed, data + length);
+    }
+
+    // handles what is left at the end of input
+    template <typename F>
+    void flush(F &&on_packets)
+    {
+      while (!_carry.empty())
+      {
+        const size_t consumed =
+            process(_carry.data(), _carry.size(), _carry_offset, true, on_packets);
+        if (!consumed)
+        {
+          break;
+        }
+        _carry.erase(begin(_carry), begin(_carry) + consumed);
+        _carry_offset += consumed;
+      }
+
+      if (!_carry.empty())
+      {
+        drop_carry();
+      }
+    }
+
+    // offset of a packet passed to on_packets from the start of input, valid inside on_packets
+    uint64_t input_offset(const uint8_t *packet) const
+    {
+      return _base_offset + static_cast<uint64_t>(packet - _base);
+    }
+
+    // bytes dropped so far while looking for packet alignment
+    uint64_t skipped_bytes() const
+    {
+      return _skipped_bytes;
+    }
+
+  private:
+    // sync search window following a suspicious packet
+    static constexpr size_t CARRY_CAPACITY = (SYNC_DEPTH + 1) * TS_PACKET_SIZE;
+    static constexpr uint8_t SYNC_BYTE = 0x47;
+    static constexpr uint64_t NO_OFFSET = ~uint64_t{0};
+
+    // bytes of a packet or of a sync search window straddling input chunks
+    std::vector<uint8_t> _carry;
+    // input offset of the first carried byte
+    uint64_t _carry_offset = 0;
+    uint64_t _input_length = 0;
+    // buffer being processed and its input offset
+    const uint8_t *_base = nullptr;
+    uint64_t _base_offset = 0;
+    bool _synced = false;
+    // input offset of a packet passed on ahead of the sync byte following it, it is kept
+    // so alignment after it is still checked but not passed on again
+    uint64_t _passed_ahead_offset = NO_OFFSET;
+    uint64_t _skipped_bytes = 0;
+    uint64_t _skipped_since_sync = 0;
+
+    // returns number of bytes consumed, the rest is too short to decide on;
+    // at the end of input alignment is accepted on fewer packets and the last one is trusted
+    template <typename F>
+    size_t process(const uint8_t *data, size_t length, uint64_t data_offset, bool end_of_input,
+        F &on_packets)
+    {
+      _base = data;
+      _base_offset = data_offset;
+
+      const size_t depth = end_of_input
+          ? std::max<size_t>(1, std::min(SYNC_DEPTH, length / TS_PACKET_SIZE))
+          : SYNC_DEPTH;
+      // a packet is emitted once the sync byte of the next one is seen as well
+      const size_t lookahead = end_of_input ? TS_PACKET_SIZE : 2 * TS_PACKET_SIZE;
+      size_t offset = 0;
+
+      auto emit = [&](size_t first, size_t last) {
+        if (first == 0 && data_offset == _passed_ahead_offset)
+        {
+          first += TS_PACKET_SIZE;
+        }
+        if (first != last)
+        {
+          on_packets(data + first, (last - first) / TS_PACKET_SIZE);
+        }
+      };
+
+      for (;;)
+      {
+        if (_synced)
+        {
+          const size_t run_start = offset;
+          while (length - offset >= lookahead && data[offset] == SYNC_BYTE &&
+                 data[offset + lookahead - TS_PACKET_SIZE] == SYNC_BYTE)
+          {
+            offset += TS_PACKET_SIZE;
+          }
+
+          if (offset != run_start)
+          {
+            emit(run_start, offset);
+          }
+
+          if (length - offset < lookahead)
+          {
+            // input ending on a packet boundary: a plausible last packet is passed on now
+            // rather than with the next input, which still has to start with a sync byte
+            if (length - offset == TS_PACKET_SIZE && is_plausible_packet(data + offset) &&
+                data_offset + offset != _passed_ahead_offset)
+            {
+              emit(offset, length);
+              _passed_ahead_offset = data_offset + offset;
+            }
+            return offset;
+          }
+
+          if (data[offset] == SYNC_BYTE)
+          {
+            // either this packet starts with a stray sync byte or bytes follow it which
+            // don't belong to any packet; it is genuine unless alignment resumes inside it
+            if (length - offset < CARRY_CAPACITY)
+            {
+              return offset;
+            }
+
+            const size_t next_sync =
+                sync_scanner::find_sync(data + offset + 1, length - offset - 1, depth);
+            if (next_sync == sync_scanner::npos || next_sync + 1 >= TS_PACKET_SIZE)
+            {
+              emit(offset, offset + TS_PACKET_SIZE);
+              offset += TS_PACKET_SIZE;
+            }
+          }
+
+          lose_sync();
+        }
+
+        const size_t sync_offset = sync_scanner::find_sync(data + offset, length - offset, depth);
+        if (sync_offset == sync_scanner::npos)
+        {
+          const size_t scanned = sync_scanner::scan_limit(length - offset, depth);
+          skip(scanned);
+          return offset + scanned;
+        }
+
+        skip(sync_offset);
+        offset += sync_offset;
+        acquire_sync();
+      }
+    }
+
+    // sync byte, no transport error and adaptation_field_control isn't reserved
+    static bool is_plausible_packet(const uint8_t *packet)
+    {
+      return packet[0] == SYNC_BYTE && !(packet[1] & 0x80) && (packet[3] & 0x30);
+    }
+
+    void skip(size_t length)
+    {
+      _skipped_bytes += length;
+      _skipped_since_sync += length;
+    }
+
+    void lose_sync();
+    void acquire_sync();
+    void drop_carry();
+  };
+
+} // namespace detail
+} // namespace mpegts
@@ -23,100 +23,49 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 */
 
 #include "ts_parser.h"
-#include "log_utils.h"
+#include "pid_log_limiter.h"
 #include "utils.hpp"
 
-#include <boost/endian/conversion.hpp>
 #include <boost/log/trivial.hpp>
 
 namespace mpegts
 {
 namespace detail
 {
-  namespace
+  void ts_parser_base::trace_skipped_packet(const ts_header_batch &batch, size_t lane)
   {
-    bool do_checks(const ts_packet_t &ts_packet)
+    if (!((batch.sync_mask >> lane) & 1))
     {
-      if (ts_packet.sync_byte != 0x47)
-      {
-        BOOST_LOG_TRIVIAL(trace) << "TS packet sync byte is invalid (expected 0x47), skipping";
-        return false;
-      }
-
-      if (ts_packet.transport_error)
-      {
-        BOOST_LOG_TRIVIAL(trace) << "TS packet is corrupt, skipping";
-        return {};
-      }
-
-      if (ts_packet.adaptation_field_ctl == 0x00 || ts_packet.adaptation_field_ctl == 0x02)
-      {
-        BOOST_LOG_TRIVIAL(trace) << "TS packet has no payload, skipping";
-        return {};
-      }
-
-      if (!((ts_packet.pid >= 0x20 && ts_packet.pid <= 0x1FFA) ||
-              (ts_packet.pid >= 0x1FFC && ts_packet.pid <= 0x1FFE)))
-      {
-        BOOST_LOG_TRIVIAL(trace) << "TS packet PID is outside of tables or PES range, skipping";
-        return {};
-      }
-
-      return true;
+      BOOST_LOG_TRIVIAL(trace) << "TS packet sync byte is invalid (expected 0x47), skipping";
     }
-  } // namespace
-
-  void ts_parser::handle_continuity_cnt(const ts_packet_t &ts_packet)
-  {
-    const auto it = _pid_to_continuity_cnt.find(ts_packet.pid);
-    if (_pid_to_continuity_cnt.find(ts_packet.pid) != _pid_to_continuity_cnt.end())
+    else if ((batch.transport_error_mask >> lane) & 1)
     {
-      if (ts_packet.continuity_cnt - it->second != 1 && it->second != 15 &&
-          ts_packet.continuity_cnt != 0)
-      {
-        BOOST_LOG_TRIVIAL(warning)
-            << "TS packet loss detected, PID: " << utils::num_to_hex(ts_packet.pid, true);
-      }
+      BOOST_LOG_TRIVIAL(trace) << "TS packet is corrupt, skipping";
     }
-
-    _pid_to_continuity_cnt[ts_packet.pid] = ts_packet.continuity_cnt;
-  }
-
-  ts_packet_opt ts_parser::parse(ts_packet_t ts_packet)
-  {
-    // converting to big endian because using big endian masks from the documentation:
-    // https://en.wikipedia.org/wiki/MPEG_transport_stream#Important_elements_of_a_transport_stream
-
-    auto header = boost::endian::native_to_big(ts_packet.header);
-
-    ts_packet.sync_byte = (header & 0xff000000) >> 24;
-    ts_packet.transport_error = (header & 0x800000);
-    ts_packet.continuity_cnt = (header & 0xf);
-    ts_packet.pusi = static_cast<bool>(header & 0x400000);
-    ts_packet.pid = (header & 0x1fff00) >> 8;
-    ts_packet.adaptation_field_ctl = (header & 0x30) >> 4;
-
-    if (!do_checks(ts_packet))
+    else if (!((batch.payload_mask >> lane) & 1))
     {
-      log_utils::log_ts_packet(ts_packet, _ts_packet_num++);
-      return {};
+      BOOST_LOG_TRIVIAL(trace) << "TS packet has no payload, skipping";
     }
-
-    if (ts_packet.adaptation_field_ctl == 0x3)
+    else if (!((batch.selected_mask >> lane) & 1))
     {
-      uint8_t adaptaion_field_len = ts_packet.data[0];
-      ts_packet.pes_offset = sizeof(uint8_t) + adaptaion_field_len;
+      BOOST_LOG_TRIVIAL(trace) << "TS packet PID is filtered out, skipping";
     }
     else
     {
-      ts_packet.pes_offset = 0;
+      BOOST_LOG_TRIVIAL(trace) << "TS packet PID is outside of PAT, tables or PES range, skipping";
     }
+  }
 
-    log_utils::log_ts_packet(ts_packet, _ts_packet_num++);
-
-    handle_continuity_cnt(ts_packet);
+  void ts_parser_base::warn_packet_loss(uint16_t pid)
+  {
+    static pid_log_limiter limiter;
+    uint64_t suppressed = 0;
 
-    return ts_packet;
+    if (limiter.allow(pid, suppressed))
+    {
+      BOOST_LOG_TRIVIAL(warning) << "TS packet loss detected, PID: " << utils::num_to_hex(pid, true)
+                                 << suppressed_messages{suppressed};
+    }
   }
 } // namespace detail
 } // namespace mpegts
@@ -20,26 +20,217 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 */
 
+#pragma once
+
+#include "log_utils.h"
 #include "mpegts.h"
 #include "mpegts_detail.h"
+#include "parser_policies.h"
+#include "pid_filter.h"
+#include "pid_table.h"
+#include "profiler.h"
+#include "stats_counters.h"
+#include "ts_header_batch.h"
+
+#include <algorithm>
+#include <cstring>
 
-#include <unordered_map>
+#include <boost/log/trivial.hpp>
 
 namespace mpegts
 {
 namespace detail
 {
-  class ts_parser
+  // policy independent part of ts_parser
+  class ts_parser_base
+  {
+  public:
+    static constexpr int8_t NO_CONTINUITY_CNT = -1;
+
+    // counter is 4 bits wide and wraps, a repeated value is an allowed duplicate packet
+    static bool is_continuous(int8_t prev_continuity_cnt, int8_t continuity_cnt)
+    {
+      return prev_continuity_cnt == NO_CONTINUITY_CNT ||
+             continuity_cnt == ((prev_continuity_cnt + 1) & 0xf) ||
+             continuity_cnt == prev_continuity_cnt;
+    }
+
+    // rate limited per PID
+    static void warn_packet_loss(uint16_t pid);
+
+  protected:
+    static void trace_skipped_packet(const ts_header_batch &batch, size_t lane);
+  };
+
+  // Policy is one of parser_policies.h, the whole packet path is inlined into parse()
+  template <typename Policy = dynamic_parser_policy>
+  class basic_ts_parser : public ts_parser_base
   {
   public:
-    ts_packet_opt parse(ts_packet_t ts_packet);
+    // check_continuity is used with continuity_check::runtime policies only, it can be turned
+    // off for a pass whose packets are checked by another one
+    explicit basic_ts_parser(pid_filter filter = {}, bool check_continuity = true)
+        : _filter(std::move(filter)), _check_continuity(check_continuity)
+    {
+    }
+
+    // PSI PIDs pass the filter whatever PIDs are selected, see pid_filter
+    void set_psi_pids(const std::vector<uint16_t> &psi_pids)
+    {
+      _filter.set_psi_pids(psi_pids);
+    }
+
+    // decodes headers of count consecutive packets at first in batches and calls
+    // on_packet(const ts_packet_view &) for every packet which is to be passed on
+    template <typename F>
+    void parse(const uint8_t *first, size_t count, F &&on_packet)
+    {
+      profiling::scope<Policy::profile> timer(profiling::stage::ts_parse);
+      ts_packet_view ts_packet;
+      stats::thread_counters *counters = nullptr;
+      if constexpr (Policy::stats)
+      {
+        counters = stats::local();
+      }
+
+      while (count)
+      {
+        const size_t batch_count = std::min(count, TS_HEADER_BATCH_SIZE);
+        decode_ts_headers(first, batch_count, _filter, _batch);
+        if (counters)
+        {
+          counters->packets.add(batch_count);
+        }
+
+        for (size_t lane = 0; lane < batch_count; ++lane)
+        {
+          const uint8_t *raw = first + lane * TS_PACKET_SIZE;
+
+          // a PAT earlier in the batch may have passed the PID of a filtered out PMT
+          if (!((_batch.valid_mask >> lane) & 1) &&
+              !(((_batch.filtered_mask >> lane) & 1) && _filter.accepts(_batch.pid[lane])))
+          {
+            skip_packet(raw, lane, counters);
+          }
+          else if (parse_packet(raw, lane, ts_packet, counters))
+          {
+            on_packet(ts_packet);
+          }
+        }
+
+        first += batch_count * TS_PACKET_SIZE;
+        count -= batch_count;
+      }
+    }
 
   private:
-    std::unordered_map<uint16_t, int8_t> _pid_to_continuity_cnt;
+    pid_filter _filter;
+    const bool _check_continuity;
+    pid_table<int8_t> _continuity_cnt{NO_CONTINUITY_CNT};
+    ts_header_batch _batch;
     uint64_t _ts_packet_num = 0;
 
-    void handle_continuity_cnt(const ts_packet_t &ts_packet);
+    bool checks_continuity() const
+    {
+      if constexpr (Policy::continuity == continuity_check::runtime)
+      {
+        return _check_continuity;
+      }
+      return Policy::continuity == continuity_check::on;
+    }
+
+    void fill_packet_view(const uint8_t *raw, size_t lane, ts_packet_view &ts_packet) const
+    {
+      std::memcpy(&ts_packet.header, raw, sizeof(uint32_t));
+      ts_packet.data = raw + sizeof(uint32_t);
+
+      ts_packet.sync_byte = raw[0];
+      ts_packet.transport_error = (_batch.transport_error_mask >> lane) & 1;
+      ts_packet.continuity_cnt = _batch.continuity_cnt[lane];
+      ts_packet.pusi = (_batch.pusi_mask >> lane) & 1;
+      ts_packet.pid = _batch.pid[lane];
+      ts_packet.adaptation_field_ctl = _batch.adaptation_field_ctl[lane];
+      ts_packet.pes_offset = 0;
+    }
+
+    void skip_packet(const uint8_t *raw, size_t lane, stats::thread_counters *counters)
+    {
+      if (counters && ((_batch.sync_mask & _batch.transport_error_mask) >> lane) & 1)
+      {
+        counters->pid(_batch.pid[lane]).tei_drops.add(1);
+      }
+
+      if constexpr (Policy::trace)
+      {
+        trace_skipped_packet(_batch, lane);
+      }
+
+      if (Policy::log_ts_packets())
+      {
+        ts_packet_view ts_packet;
+        fill_packet_view(raw, lane, ts_packet);
+        log_utils::log_ts_packet(ts_packet, _ts_packet_num);
+      }
+      ++_ts_packet_num;
+    }
+
+    bool parse_packet(const uint8_t *raw, size_t lane, ts_packet_view &ts_packet,
+        stats::thread_counters *counters)
+    {
+      // header fields are already decoded and checked for the whole batch
+      fill_packet_view(raw, lane, ts_packet);
+
+      if (ts_packet.adaptation_field_ctl == 0x3)
+      {
+        uint8_t adaptaion_field_len = ts_packet.data[0];
+        if (adaptaion_field_len >= TS_PACKET_DATA_SIZE)
+        {
+          // payload would start past the end of the packet
+          if constexpr (Policy::trace)
+          {
+            BOOST_LOG_TRIVIAL(trace) << "TS packet adaptation field length is invalid, skipping";
+          }
+          if (Policy::log_ts_packets())
+          {
+            log_utils::log_ts_packet(ts_packet, _ts_packet_num);
+          }
+          ++_ts_packet_num;
+          return false;
+        }
+        ts_packet.pes_offset = sizeof(uint8_t) + adaptaion_field_len;
+      }
+
+      if (Policy::log_ts_packets())
+      {
+        log_utils::log_ts_packet(ts_packet, _ts_packet_num);
+      }
+      ++_ts_packet_num;
+
+      stats::pid_counters *pid_counters = counters ? &counters->pid(ts_packet.pid) : nullptr;
+      if (pid_counters)
+      {
+        pid_counters->packets.add(1);
+      }
+
+      if (checks_continuity())
+      {
+        int8_t &prev_continuity_cnt = _continuity_cnt[ts_packet.pid];
+        if (!is_continuous(prev_continuity_cnt, ts_packet.continuity_cnt))
+        {
+          if (pid_counters)
+          {
+            pid_counters->cc_errors.add(1);
+          }
+          warn_packet_loss(ts_packet.pid);
+        }
+        prev_continuity_cnt = ts_packet.continuity_cnt;
+      }
+
+      return true;
+    }
   };
 
+  using ts_parser = basic_ts_parser<>;
+
 } // namespace detail
 } // namespace mpegts
@@ -0,0 +1,379 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "udp_source.h"
+#include "mpegts_detail.h"
+
+#include <cstring>
+#include <system_error>
+
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // datagrams pulled by one recvmmsg() and room for each of them; TS over UDP usually
+    // carries 7 TS packets, plus 12 bytes of header over RTP
+    constexpr size_t BATCH_SIZE = 64;
+    constexpr size_t DATAGRAM_SIZE = 2048;
+    // how often a thread waiting for datagrams checks for interruption
+    constexpr int POLL_TIMEOUT_MS = 100;
+
+    constexpr size_t RTP_HEADER_SIZE = 12;
+    constexpr uint8_t RTP_VERSION = 2;
+
+    const std::string UDP_SCHEME = "udp://";
+    const std::string RTP_SCHEME = "rtp://";
+
+    std::system_error make_error(int error, const std::string &what)
+    {
+      return std::system_error(error, std::generic_category(), what);
+    }
+
+    bool starts_with(const std::string &value, const std::string &prefix)
+    {
+      return value.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    in_addr resolve(const std::string &host, const std::string &url)
+    {
+      addrinfo hints;
+      std::memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_DGRAM;
+
+      addrinfo *result = nullptr;
+      if (int error = ::getaddrinfo(host.empty() ? "0.0.0.0" : host.c_str(), nullptr, &hints,
+              &result))
+      {
+        throw std::invalid_argument(
+            "Failed to resolve " + host + " in " + url + ": " + ::gai_strerror(error));
+      }
+      const in_addr address = reinterpret_cast<sockaddr_in *>(result->ai_addr)->sin_addr;
+      ::freeaddrinfo(result);
+      return address;
+    }
+
+    void set_option(int fd, int level, int name, int value, const char *what)
+    {
+      if (::setsockopt(fd, level, name, &value, sizeof(value)) < 0)
+      {
+        throw make_error(errno, what);
+      }
+    }
+  } // namespace
+
+  struct udp_source::control_t
+  {
+    alignas(cmsghdr) uint8_t data[CMSG_SPACE(sizeof(uint32_t))];
+  };
+
+  bool is_network_url(const std::string &name)
+  {
+    return starts_with(name, UDP_SCHEME) || starts_with(name, RTP_SCHEME);
+  }
+
+  udp_source::udp_source(const std::string &url, size_t receive_buffer_size)
+      : _is_rtp(starts_with(url, RTP_SCHEME)), _buffers(BATCH_SIZE * DATAGRAM_SIZE),
+        _iovecs(BATCH_SIZE), _controls(BATCH_SIZE), _messages(BATCH_SIZE)
+  {
+    if (!is_network_url(url))
+    {
+      throw std::invalid_argument("Not a udp:// or rtp:// URL: " + url);
+    }
+
+    // [source@]address:port
+    std::string endpoint = url.substr(_is_rtp ? RTP_SCHEME.size() : UDP_SCHEME.size());
+    std::string source;
+    if (const auto at = endpoint.find('@'); at != std::string::npos)
+    {
+      source = endpoint.substr(0, at);
+      endpoint.erase(0, at + 1);
+    }
+    const auto colon = endpoint.rfind(':');
+    if (colon == std::string::npos)
+    {
+      throw std::invalid_argument("Port is missing in " + url);
+    }
+    size_t pos = 0;
+    unsigned long port = 0;
+    try
+    {
+      port = std::stoul(endpoint.substr(colon + 1), &pos);
+    }
+    catch (const std::exception &)
+    {
+    }
+    if (!pos || pos != endpoint.size() - colon - 1 || !port || port > 0xffff)
+    {
+      throw std::invalid_argument("Invalid port in " + url);
+    }
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr = resolve(endpoint.substr(0, colon), url);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    const bool is_multicast = IN_MULTICAST(ntohl(address.sin_addr.s_addr));
+
+    _fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0)
+    {
+      throw make_error(errno, "socket");
+    }
+
+    try
+    {
+      set_option(_fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+
+      // SO_RCVBUFFORCE goes past net.core.rmem_max but needs CAP_NET_ADMIN
+      const int requested = static_cast<int>(std::min<size_t>(receive_buffer_size, INT32_MAX / 2));
+      if (::setsockopt(_fd, SOL_SOCKET, SO_RCVBUFFORCE, &requested, sizeof(requested)) < 0)
+      {
+        set_option(_fd, SOL_SOCKET, SO_RCVBUF, requested, "SO_RCVBUF");
+      }
+      int actual = 0;
+      socklen_t actual_length = sizeof(actual);
+      ::getsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &actual, &actual_length);
+      // the kernel reports twice the size asked for, the other half is its bookkeeping
+      if (actual / 2 < requested)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "UDP receive buffer is " << actual / 2 << " bytes instead of "
+                                   << requested << ", raise net.core.rmem_max to get more";
+      }
+
+      // every datagram then carries the number of datagrams the socket dropped so far
+      set_option(_fd, SOL_SOCKET, SO_RXQ_OVFL, 1, "SO_RXQ_OVFL");
+
+      // a multicast socket bound to the group only gets that group's datagrams
+      if (::bind(_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+      {
+        throw make_error(errno, "Failed to bind " + url);
+      }
+
+      if (is_multicast && !source.empty())
+      {
+        ip_mreq_source request;
+        std::memset(&request, 0, sizeof(request));
+        request.imr_multiaddr = address.sin_addr;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        request.imr_sourceaddr = resolve(source, url);
+        if (::setsockopt(_fd, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP, &request, sizeof(request)) < 0)
+        {
+          throw make_error(errno, "Failed to join " + url);
+        }
+      }
+      else if (is_multicast)
+      {
+        ip_mreq request;
+        std::memset(&request, 0, sizeof(request));
+        request.imr_multiaddr = address.sin_addr;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (::setsockopt(_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) < 0)
+        {
+          throw make_error(errno, "Failed to join " + url);
+        }
+      }
+      else if (!source.empty())
+      {
+        throw std::invalid_argument("Source can only be given for multicast groups: " + url);
+      }
+    }
+    catch (...)
+    {
+      ::close(_fd);
+      throw;
+    }
+
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+      _iovecs[i] = iovec{&_buffers[i * DATAGRAM_SIZE], DATAGRAM_SIZE};
+      std::memset(&_messages[i], 0, sizeof(mmsghdr));
+      _messages[i].msg_hdr.msg_iov = &_iovecs[i];
+      _messages[i].msg_hdr.msg_iovlen = 1;
+      _messages[i].msg_hdr.msg_control = _controls[i].data;
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Receiving " << (_is_rtp ? "RTP" : "UDP") << " on " << url;
+  }
+
+  udp_source::~udp_source()
+  {
+    ::close(_fd);
+
+    BOOST_LOG_TRIVIAL(info) << "Received " << _datagrams << " datagrams, " << _bytes
+                            << " bytes; dropped by kernel: " << _kernel_drops
+                            << (_is_rtp ? "; lost RTP packets: " + std::to_string(_rtp_lost) : "");
+  }
+
+  buffer_slice udp_source::read()
+  {
+    for (;;)
+    {
+      if (_next == _received)
+      {
+        receive();
+      }
+
+      auto &message = _messages[_next];
+      uint8_t *data = &_buffers[_next * DATAGRAM_SIZE];
+      const size_t length = message.msg_len;
+      ++_next;
+
+      if (message.msg_hdr.msg_flags & MSG_TRUNC)
+      {
+        BOOST_LOG_TRIVIAL(warning)
+            << "UDP datagram is larger than " << DATAGRAM_SIZE << " bytes, truncated";
+      }
+      check_kernel_drops(message.msg_hdr);
+      ++_datagrams;
+      _bytes += length;
+
+      const buffer_slice payload = _is_rtp ? rtp_payload(data, length) : buffer_slice{data, length};
+      if (payload.length)
+      {
+        return payload;
+      }
+    }
+  }
+
+  void udp_source::receive()
+  {
+    for (;;)
+    {
+      boost::this_thread::interruption_point();
+
+      pollfd fd{_fd, POLLIN, 0};
+      const int ready = ::poll(&fd, 1, POLL_TIMEOUT_MS);
+      if (ready < 0 && errno != EINTR)
+      {
+        throw make_error(errno, "poll");
+      }
+      if (ready <= 0)
+      {
+        continue;
+      }
+
+      // the kernel overwrites these on every call
+      for (auto &message : _messages)
+      {
+        message.msg_hdr.msg_controllen = sizeof(control_t::data);
+        message.msg_hdr.msg_flags = 0;
+      }
+
+      const int count = ::recvmmsg(_fd, _messages.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+      if (count < 0)
+      {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+          continue;
+        }
+        throw make_error(errno, "recvmmsg");
+      }
+
+      _received = static_cast<size_t>(count);
+      _next = 0;
+      if (_received)
+      {
+        return;
+      }
+    }
+  }
+
+  void udp_source::check_kernel_drops(msghdr &header)
+  {
+    for (cmsghdr *control = CMSG_FIRSTHDR(&header); control;
+         control = CMSG_NXTHDR(&header, control))
+    {
+      if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SO_RXQ_OVFL)
+      {
+        continue;
+      }
+
+      uint32_t drops = 0;
+      std::memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+      if (drops != _kernel_drops)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "Kernel dropped " << drops - _kernel_drops
+                                   << " UDP datagrams, receive buffer overflow";
+        _kernel_drops = drops;
+      }
+    }
+  }
+
+  buffer_slice udp_source::rtp_payload(uint8_t *data, size_t length)
+  {
+    // version, padding, extension, CSRC count; marker, payload type; sequence number;
+    // timestamp; SSRC; CSRCs; extension header and data
+    size_t header_size = RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+    if (length < RTP_HEADER_SIZE || (data[0] >> 6) != RTP_VERSION || length < header_size)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "Malformed RTP packet, skipping";
+      return {};
+    }
+    if (data[0] & 0x10)
+    {
+      if (length < header_size + 4)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "Malformed RTP header extension, skipping";
+        return {};
+      }
+      header_size += 4 + 4 * ((data[header_size + 2] << 8) | data[header_size + 3]);
+    }
+    const size_t padding = (data[0] & 0x20) ? data[length - 1] : 0;
+    if (header_size + padding > length)
+    {
+      BOOST_LOG_TRIVIAL(warning) << "Malformed RTP packet, skipping";
+      return {};
+    }
+
+    const uint16_t sequence = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    if (_rtp_sequence >= 0)
+    {
+      const uint16_t lost = static_cast<uint16_t>(sequence - _rtp_sequence - 1);
+      // a large gap is a reordered or repeated packet rather than a loss
+      if (lost && lost < 0x8000)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "Lost " << lost << " RTP packets";
+        _rtp_lost += lost;
+      }
+      else if (lost)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "RTP packet out of order";
+      }
+    }
+    _rtp_sequence = sequence;
+
+    return buffer_slice{data + header_size, length - header_size - padding};
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,81 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "input_source.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  // true for udp:// and rtp:// inputs
+  bool is_network_url(const std::string &name);
+
+  // receives TS over UDP, or over RTP over UDP, from udp://[source@]address:port or
+  // rtp://[source@]address:port; multicast groups are joined on the default interface,
+  // datagrams are pulled in batches with recvmmsg() and handed out one by one
+  class udp_source : public input_source
+  {
+  public:
+    udp_source(const std::string &url, size_t receive_buffer_size);
+    ~udp_source() override;
+    udp_source(const udp_source &) = delete;
+    udp_source &operator=(const udp_source &) = delete;
+
+    // waits for datagrams, never returns the end of input; honours boost::thread interruption
+    buffer_slice read() override;
+
+  private:
+    struct control_t;
+
+    int _fd = -1;
+    bool _is_rtp = false;
+
+    std::vector<uint8_t> _buffers;
+    std::vector<iovec> _iovecs;
+    std::vector<control_t> _controls;
+    std::vector<mmsghdr> _messages;
+    // datagrams received by the last recvmmsg() and the next one to hand out
+    size_t _received = 0;
+    size_t _next = 0;
+
+    // -1 until the first RTP packet
+    int32_t _rtp_sequence = -1;
+
+    uint32_t _kernel_drops = 0;
+    uint64_t _datagrams = 0;
+    uint64_t _bytes = 0;
+    uint64_t _rtp_lost = 0;
+
+    void receive();
+    void check_kernel_drops(msghdr &header);
+    buffer_slice rtp_payload(uint8_t *data, size_t length);
+  };
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,407 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "uring_source.h"
+#include "mpegts_detail.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#include <boost/log/trivial.hpp>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace detail
+{
+  namespace
+  {
+    // reads kept in flight and size of each of them, multiple of TS packet size
+    constexpr unsigned QUEUE_DEPTH = 4;
+    constexpr size_t READ_BLOCK_SIZE = TS_PACKET_SIZE * 8 * 1024;
+    constexpr size_t READ_BLOCK_ALIGNMENT = 4096;
+
+    std::system_error make_error(int error, const std::string &what)
+    {
+      return std::system_error(error, std::generic_category(), what);
+    }
+
+    template <typename T>
+    T *ring_ptr(void *base, uint32_t offset)
+    {
+      return reinterpret_cast<T *>(static_cast<uint8_t *>(base) + offset);
+    }
+  } // namespace
+
+  // minimal io_uring wrapper over raw syscalls: one submission and completion queue
+  // with the given buffers registered as fixed buffers
+  class uring_source::ring
+  {
+  public:
+    ring(unsigned entries, const std::vector<iovec> &buffers)
+    {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+
+      _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+      if (_fd < 0)
+      {
+        throw make_error(errno, "io_uring_setup");
+      }
+
+      try
+      {
+        map_rings(params);
+
+        if (::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, buffers.data(),
+                buffers.size()) < 0)
+        {
+          throw make_error(errno, "io_uring_register");
+        }
+      }
+      catch (...)
+      {
+        unmap_rings();
+        ::close(_fd);
+        throw;
+      }
+    }
+
+    ~ring()
+    {
+      unmap_rings();
+      ::close(_fd);
+    }
+
+    ring(const ring &) = delete;
+    ring &operator=(const ring &) = delete;
+
+    void submit_read(int fd, uint16_t buf_index, uint8_t *data, size_t length, uint64_t offset,
+        uint64_t user_data)
+    {
+      // single producer, the kernel only reads the tail
+      const unsigned tail = *_sq_tail;
+      const unsigned index = tail & *_sq_mask;
+
+      io_uring_sqe &sqe = _sqes[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_READ_FIXED;
+      sqe.fd = fd;
+      sqe.addr = reinterpret_cast<uint64_t>(data);
+      sqe.len = static_cast<uint32_t>(length);
+      sqe.off = offset;
+      sqe.buf_index = buf_index;
+      sqe.user_data = user_data;
+
+      _sq_array[index] = index;
+      __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+      if (enter(1, 0, 0) < 0)
+      {
+        throw make_error(errno, "io_uring_enter");
+      }
+    }
+
+    // blocks until a completion is available and consumes it
+    io_uring_cqe wait()
+    {
+      for (;;)
+      {
+        const unsigned head = *_cq_head;
+        if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+        {
+          const io_uring_cqe cqe = _cqes[head & *_cq_mask];
+          __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+          return cqe;
+        }
+
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+          throw make_error(errno, "io_uring_enter");
+        }
+      }
+    }
+
+  private:
+    int _fd = -1;
+
+    void *_sq_ring = MAP_FAILED;
+    size_t _sq_ring_size = 0;
+    void *_cq_ring = MAP_FAILED;
+    size_t _cq_ring_size = 0;
+    io_uring_sqe *_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t _sqes_size = 0;
+
+    unsigned *_sq_tail = nullptr;
+    unsigned *_sq_mask = nullptr;
+    unsigned *_sq_array = nullptr;
+    unsigned *_cq_head = nullptr;
+    unsigned *_cq_tail = nullptr;
+    unsigned *_cq_mask = nullptr;
+    io_uring_cqe *_cqes = nullptr;
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+      return static_cast<int>(
+          ::syscall(__NR_io_uring_enter, _fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    void map_rings(const io_uring_params &params)
+    {
+      _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single_mmap)
+      {
+        _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+      }
+
+      _sq_ring = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+      if (_sq_ring == MAP_FAILED)
+      {
+        throw make_error(errno, "mmap io_uring SQ ring");
+      }
+
+      if (single_mmap)
+      {
+        _cq_ring = _sq_ring;
+      }
+      else
+      {
+        _cq_ring = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED)
+        {
+          throw make_error(errno, "mmap io_uring CQ ring");
+        }
+      }
+
+      _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      _sqes = static_cast<io_uring_sqe *>(::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+      if (_sqes == MAP_FAILED)
+      {
+        throw make_error(errno, "mmap io_uring SQEs");
+      }
+
+      _sq_tail = ring_ptr<unsigned>(_sq_ring, params.sq_off.tail);
+      _sq_mask = ring_ptr<unsigned>(_sq_ring, params.sq_off.ring_mask);
+      _sq_array = ring_ptr<unsigned>(_sq_ring, params.sq_off.array);
+      _cq_head = ring_ptr<unsigned>(_cq_ring, params.cq_off.head);
+      _cq_tail = ring_ptr<unsigned>(_cq_ring, params.cq_off.tail);
+      _cq_mask = ring_ptr<unsigned>(_cq_ring, params.cq_off.ring_mask);
+      _cqes = ring_ptr<io_uring_cqe>(_cq_ring, params.cq_off.cqes);
+    }
+
+    void unmap_rings()
+    {
+      if (_sqes != MAP_FAILED)
+      {
+        ::munmap(_sqes, _sqes_size);
+      }
+      if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring)
+      {
+        ::munmap(_cq_ring, _cq_ring_size);
+      }
+      if (_sq_ring != MAP_FAILED)
+      {
+        ::munmap(_sq_ring, _sq_ring_size);
+      }
+    }
+  };
+
+  uring_source::uring_source(const std::string &file_name) : _memory(nullptr, &std::free)
+  {
+    _fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0)
+    {
+      throw make_error(errno, "Failed to open " + file_name);
+    }
+
+    void *memory = nullptr;
+    const int error =
+        ::posix_memalign(&memory, READ_BLOCK_ALIGNMENT, QUEUE_DEPTH * READ_BLOCK_SIZE);
+    if (error)
+    {
+      ::close(_fd);
+      throw make_error(error, "Failed to allocate read buffers");
+    }
+    _memory.reset(static_cast<uint8_t *>(memory));
+
+    std::vector<iovec> iovecs;
+    for (unsigned i = 0; i < QUEUE_DEPTH; ++i)
+    {
+      uint8_t *data = _memory.get() + i * READ_BLOCK_SIZE;
+      _blocks.push_back(block_t{data, 0, 0, block_state::idle});
+      iovecs.push_back(iovec{data, READ_BLOCK_SIZE});
+    }
+
+    try
+    {
+      _ring = std::make_unique<ring>(QUEUE_DEPTH, iovecs);
+    }
+    catch (const std::system_error &e)
+    {
+      BOOST_LOG_TRIVIAL(info) << "io_uring is not available (" << e.what()
+                              << "), falling back to read()";
+      return;
+    }
+
+    ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (auto &block : _blocks)
+    {
+      submit(block);
+    }
+  }
+
+  uring_source::~uring_source()
+  {
+    // registered buffers must not be released while the kernel may still write into them
+    if (_ring)
+    {
+      for (auto &block : _blocks)
+      {
+        try
+        {
+          wait_for(block);
+        }
+        catch (const std::exception &)
+        {
+          // nothing sensible to do in destructor, request is reaped anyway
+        }
+      }
+      _ring.reset();
+    }
+    ::close(_fd);
+  }
+
+  buffer_slice uring_source::read()
+  {
+    if (!_ring)
+    {
+      return read_fallback();
+    }
+
+    if (_consumed_block)
+    {
+      _consumed_block->state = block_state::idle;
+      if (!_eof)
+      {
+        submit(*_consumed_block);
+      }
+      _consumed_block = nullptr;
+    }
+
+    block_t &block = _blocks[_next_block];
+    wait_for(block);
+
+    if (block.state == block_state::idle || !block.length)
+    {
+      // blocks are consumed in offset order, so everything past this one is empty as well
+      block.state = block_state::idle;
+      return {};
+    }
+
+    _next_block = (_next_block + 1) % _blocks.size();
+    _consumed_block = &block;
+
+    return buffer_slice{block.data, block.length};
+  }
+
+  void uring_source::submit(block_t &block)
+  {
+    block.offset = _next_offset;
+    block.length = 0;
+    block.state = block_state::in_flight;
+    _next_offset += READ_BLOCK_SIZE;
+
+    _ring->submit_read(_fd, static_cast<uint16_t>(&block - _blocks.data()), block.data,
+        READ_BLOCK_SIZE, block.offset, &block - _blocks.data());
+  }
+
+  void uring_source::wait_for(block_t &block)
+  {
+    while (block.state == block_state::in_flight)
+    {
+      const io_uring_cqe cqe = _ring->wait();
+      block_t &completed = _blocks[cqe.user_data];
+
+      if (cqe.res < 0)
+      {
+        completed.state = block_state::idle;
+        _eof = true;
+        throw make_error(-cqe.res, "io_uring read");
+      }
+
+      completed.length += static_cast<size_t>(cqe.res);
+
+      if (cqe.res == 0 || completed.length == READ_BLOCK_SIZE)
+      {
+        completed.state = block_state::ready;
+        _eof = _eof || cqe.res == 0;
+      }
+      else
+      {
+        // short read, request the rest so handed out blocks stay packet aligned
+        _ring->submit_read(_fd, static_cast<uint16_t>(cqe.user_data),
+            completed.data + completed.length, READ_BLOCK_SIZE - completed.length,
+            completed.offset + completed.length, cqe.user_data);
+      }
+    }
+  }
+
+  buffer_slice uring_source::read_fallback()
+  {
+    block_t &block = _blocks.front();
+    block.length = 0;
+
+    while (!_eof && block.length < READ_BLOCK_SIZE)
+    {
+      const ssize_t res = ::read(_fd, block.data + block.length, READ_BLOCK_SIZE - block.length);
+      if (res < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        throw make_error(errno, "read");
+      }
+
+      _eof = res == 0;
+      block.length += static_cast<size_t>(res);
+    }
+
+    return buffer_slice{block.data, block.length};
+  }
+} // namespace detail
+} // namespace mpegts
@@ -0,0 +1,84 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "input_source.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mpegts
+{
+namespace detail
+{
+  // keeps several large reads in flight through io_uring with registered fixed buffers,
+  // so parsing of one block overlaps the I/O of the following ones;
+  // falls back to a plain read() loop when io_uring is not available
+  class uring_source : public input_source
+  {
+  public:
+    explicit uring_source(const std::string &file_name);
+    ~uring_source() override;
+    uring_source(const uring_source &) = delete;
+    uring_source &operator=(const uring_source &) = delete;
+
+    buffer_slice read() override;
+
+  private:
+    class ring;
+
+    enum class block_state
+    {
+      // not owned by the kernel and holds no unread data
+      idle,
+      in_flight,
+      // read completed, data is not handed out yet
+      ready
+    };
+
+    struct block_t
+    {
+      uint8_t *data;
+      uint64_t offset;
+      size_t length;
+      block_state state;
+    };
+
+    int _fd = -1;
+    std::unique_ptr<uint8_t, void (*)(void *)> _memory;
+    std::vector<block_t> _blocks;
+    std::unique_ptr<ring> _ring;
+
+    uint64_t _next_offset = 0;
+    size_t _next_block = 0;
+    // block handed out by the previous read(), resubmitted on the next call
+    block_t *_consumed_block = nullptr;
+    bool _eof = false;
+
+    void submit(block_t &block);
+    void wait_for(block_t &block);
+    buffer_slice read_fallback();
+  };
+} // namespace detail
+} // namespace mpegts
@@ -21,12 +21,21 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 */
 
 #include "logger.h"
+#include "detail/trace_ring.h"
 
+#include <boost/core/null_deleter.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
 #include <boost/log/support/date_time.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/file.hpp>
+#include <boost/make_shared.hpp>
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <mutex>
 
 namespace logger
 {
@@ -35,6 +44,117 @@ std::atomic_bool log_ts_packets;
 std::atomic_bool log_pes_packets;
 
 namespace log = boost::log;
+namespace sinks = boost::log::sinks;
+
+namespace
+{
+// records waiting for a sink thread, the oldest are dropped beyond that
+constexpr size_t LOG_QUEUE_SIZE = 8192;
+
+std::atomic<uint64_t> dropped_records{0};
+
+// asynchronous_sink queueing strategy which never blocks the logging thread: a record
+// coming to a full queue pushes out the oldest one
+template <size_t MaxQueueSize>
+class drop_oldest_queue
+{
+protected:
+  drop_oldest_queue() = default;
+  template <typename ArgsT>
+  explicit drop_oldest_queue(const ArgsT &)
+  {
+  }
+
+  void enqueue(const log::record_view &record)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_queue.size() == MaxQueueSize)
+    {
+      _queue.pop_front();
+      dropped_records.fetch_add(1, std::memory_order_relaxed);
+    }
+    _queue.push_back(record);
+    _ready.notify_one();
+  }
+
+  bool try_enqueue(const log::record_view &record)
+  {
+    enqueue(record);
+    return true;
+  }
+
+  bool try_dequeue_ready(log::record_view &record)
+  {
+    return try_dequeue(record);
+  }
+
+  bool try_dequeue(log::record_view &record)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return pop(record);
+  }
+
+  // blocks until there is a record, false when interrupted
+  bool dequeue_ready(log::record_view &record)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _ready.wait(lock, [this]() { return !_queue.empty() || _interrupted; });
+    if (_interrupted)
+    {
+      _interrupted = false;
+      return false;
+    }
+    return pop(record);
+  }
+
+  void interrupt_dequeue()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _interrupted = true;
+    _ready.notify_one();
+  }
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::deque<log::record_view> _queue;
+  bool _interrupted = false;
+
+  bool pop(log::record_view &record)
+  {
+    if (_queue.empty())
+    {
+      return false;
+    }
+    record.swap(_queue.front());
+    _queue.pop_front();
+    return true;
+  }
+};
+
+using console_sink_t =
+    sinks::asynchronous_sink<sinks::text_ostream_backend, drop_oldest_queue<LOG_QUEUE_SIZE>>;
+using file_sink_t =
+    sinks::asynchronous_sink<sinks::text_file_backend, drop_oldest_queue<LOG_QUEUE_SIZE>>;
+
+boost::shared_ptr<console_sink_t> console_sink;
+boost::shared_ptr<file_sink_t> file_sink;
+
+template <typename Sink>
+void stop_sink(boost::shared_ptr<Sink> &sink)
+{
+  if (sink)
+  {
+    log::core::get()->remove_sink(sink);
+    sink->stop();
+    // what the sink thread has not written yet is written here
+    sink->flush();
+    sink.reset();
+  }
+}
+} // namespace
 
 void init(log::trivial::severity_level severity_level, const std::string &file_name)
 {
@@ -55,13 +175,55 @@ void init(log::trivial::severity_level severity_level, const std::string &file_n
   const auto log_fmt = log::expressions::format("[%1%] (%2%) [%3%] %4% : %5%") % fmt_timestamp %
       fmt_thread_id % fmt_severity % fmt_scope % log::expressions::smessage;
 
-  auto consoleSink = log::add_console_log(std::clog);
-  consoleSink->set_formatter(log_fmt);
+  // records are formatted and written on the sink threads, flushing every record keeps the
+  // console and the file up to date without costing the logging thread anything
+  auto console_backend = boost::make_shared<sinks::text_ostream_backend>();
+  console_backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+  console_backend->auto_flush(true);
+  console_sink = boost::make_shared<console_sink_t>(console_backend);
+  console_sink->set_formatter(log_fmt);
+  log::core::get()->add_sink(console_sink);
+
+  auto file_backend = boost::make_shared<sinks::text_file_backend>(
+      log::keywords::file_name = file_name, log::keywords::open_mode = std::ios_base::out,
+      log::keywords::auto_flush = true);
+  file_sink = boost::make_shared<file_sink_t>(file_backend);
+  file_sink->set_formatter(log_fmt);
+  log::core::get()->add_sink(file_sink);
+}
 
-  auto fsSink = log::add_file_log(log::keywords::file_name = file_name,
-      log::keywords::open_mode = std::ios_base::out, log::keywords::auto_flush = true);
+void shutdown()
+{
+  const uint64_t dropped = dropped_records.exchange(0);
+  if (dropped)
+  {
+    BOOST_LOG_TRIVIAL(warning) << "Log queue overflowed, " << dropped << " records dropped";
+  }
+
+  stop_sink(console_sink);
+  stop_sink(file_sink);
+}
 
-  fsSink->set_formatter(log_fmt);
+void start_packet_trace(const std::string &file_name, size_t ring_size)
+{
+  const std::time_t now = std::time(nullptr);
+  std::tm local_time{};
+  localtime_r(&now, &local_time);
+
+  std::string expanded(file_name.size() + 64, '\0');
+  expanded.resize(std::strftime(&expanded[0], expanded.size(), file_name.c_str(), &local_time));
+  if (expanded.empty())
+  {
+    expanded = file_name;
+  }
+
+  mpegts::detail::trace::start(expanded, ring_size);
+  BOOST_LOG_TRIVIAL(info) << "Packet trace file: " << expanded;
+}
+
+void stop_packet_trace()
+{
+  mpegts::detail::trace::stop();
 }
 
 } // namespace logger
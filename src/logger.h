@@ -23,13 +23,25 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 #pragma once
 
 #include <atomic>
+#include <string>
 #include <boost/log/trivial.hpp>
 
 namespace logger
 {
+// console and file_name sinks write records on their own threads from a bounded queue, the
+// oldest records are dropped when it is full so logging never blocks
 void init(boost::log::trivial::severity_level severity_level, const std::string &file_name);
+// writes out queued records and stops the sink threads
+void shutdown();
 
 extern std::atomic<boost::log::trivial::severity_level> current_severity_level;
 extern std::atomic_bool log_ts_packets;
 extern std::atomic_bool log_pes_packets;
+
+// TS and PES packets selected by log_ts_packets and log_pes_packets are written to a binary
+// trace file rather than to the log, mpeg-ts-trace-decode renders it as JSON;
+// file_name takes the same %Y%m%d_%H%M%S placeholders as the log file name, ring_size is in
+// records per thread
+void start_packet_trace(const std::string &file_name, size_t ring_size);
+void stop_packet_trace();
 } // namespace logger
@@ -20,9 +20,13 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 */
 
+#include "batch_demux_service.h"
 #include "demux_service.h"
 #include "logger.h"
 #include "options.h"
+#include "pes_file_writer.h"
+#include "profiling.h"
+#include "stats_exporter.h"
 #include "utils.hpp"
 
 #include <boost/filesystem.hpp>
@@ -34,16 +38,100 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 #include <boost/asio/post.hpp>
 #include <boost/asio/signal_set.hpp>
 
-#include <fstream>
 #include <iostream>
-#include <unordered_map>
+#include <memory>
+#include <set>
 
 namespace asio = boost::asio;
 
+namespace fs = boost::filesystem;
+
 namespace
 {
 const std::string log_file_name = "mpeg-ts-demux_%Y%m%d_%H%M%S.log";
-using ofs_map_t = std::unordered_map<uint16_t, std::ofstream>;
+
+// writes every PID to its own file in output_dir; the files are flushed and closed when the
+// last copy of the callback is destroyed
+mpegts::batch_received_callback_t make_file_writer(
+    std::string output_dir, const mpegts::file_writer_settings &settings)
+{
+  auto writer = std::make_shared<mpegts::pes_file_writer>(std::move(output_dir), settings);
+
+  return [writer](const mpegts::pes_batch_t &batch) {
+    if (logger::current_severity_level <= boost::log::trivial::trace)
+    {
+      for (const auto &packet : batch)
+      {
+        BOOST_LOG_TRIVIAL(trace) << "Got PES packet with PID: "
+                                 << utils::num_to_hex(packet.pid, true)
+                                 << " and payload length: " << packet.payload.length;
+      }
+    }
+
+    writer->write(batch);
+  };
+}
+
+// one subdirectory per input file, named by the file stem and made unique with a suffix
+std::vector<std::string> make_output_dirs(
+    const std::vector<std::string> &input_files, const std::string &output_dir)
+{
+  std::vector<std::string> result;
+  std::set<std::string> used_names;
+
+  for (const auto &input_file : input_files)
+  {
+    const std::string stem = fs::path(input_file).stem().string();
+    std::string name = stem;
+    for (size_t i = 1; !used_names.insert(name).second; ++i)
+    {
+      name = stem + "_" + std::to_string(i);
+    }
+
+    const auto dir = fs::path(output_dir) / name;
+    fs::create_directories(dir);
+    result.push_back(dir.string());
+  }
+  return result;
+}
+
+// logs statistics on every signal, until the context is stopped
+void log_stats_on_signal(asio::signal_set &signal_set, mpegts::stats_exporter &stats)
+{
+  signal_set.async_wait([&signal_set, &stats](const auto &ec, int) {
+    if (!ec)
+    {
+      stats.log_snapshot();
+      log_stats_on_signal(signal_set, stats);
+    }
+  });
+}
+
+template <typename Service>
+int run(Service &svc, asio::io_context &signal_handling_ctx)
+{
+  asio::signal_set signal_set(signal_handling_ctx, SIGINT, SIGTERM);
+
+  bool interrupted = false;
+
+  signal_set.async_wait([&svc, &interrupted](const auto &ec, int sig_code) {
+    BOOST_LOG_TRIVIAL(trace) << "Got signal: " << sig_code << "; stopping...";
+    if (ec)
+    {
+      BOOST_LOG_TRIVIAL(error) << "Error: " << ec.message();
+    }
+
+    interrupted = true;
+    svc.stop();
+  });
+
+  svc.start();
+
+  // other handlers, e.g. statistics on SIGUSR1, don't make the exit code
+  signal_handling_ctx.run();
+  svc.join();
+  return interrupted ? 1 : 0;
+}
 } // namespace
 
 int main(int argc, char *argv[])
@@ -60,56 +148,59 @@ int main(int argc, char *argv[])
     logger::init(options.get_log_severity_level(), log_file_name);
     options.print();
 
-    asio::io_context signal_handling_ctx;
+    if (logger::log_ts_packets || logger::log_pes_packets)
+    {
+      logger::start_packet_trace(options.get_trace_file_name(), options.get_trace_ring_size());
+    }
 
-    ofs_map_t ofs_map;
-
-    mpegts::demux_service svc(options.get_input_file_name(), signal_handling_ctx,
-        [&ofs_map, &options](const mpegts::pes_packet_t &packet) {
-          auto it = ofs_map.find(packet.pid);
-          if (it == ofs_map.end())
-          {
-            std::ofstream ofs;
-            auto exception_mask = ofs.exceptions() | std::ios::failbit;
-            ofs.exceptions(exception_mask);
-            ofs.open((boost::filesystem::path(options.get_oputput_directory()) /
-                         utils::num_to_hex(packet.pid, true))
-                         .string(),
-                std::ios::out | std::ios::binary | std::ios::trunc);
-            it = ofs_map.emplace(packet.pid, std::move(ofs)).first;
-          }
-
-          BOOST_LOG_TRIVIAL(trace)
-              << "Got PES packet with PID: " << utils::num_to_hex(packet.pid, true)
-              << " and payload length: " << packet.payload.length;
-
-          it->second.write(
-              reinterpret_cast<const char *>(packet.payload.data), packet.payload.length);
-        });
-
-    asio::signal_set signal_set(signal_handling_ctx, SIGINT, SIGTERM);
-
-    signal_set.async_wait([&svc](const auto &ec, int sig_code) {
-      BOOST_LOG_TRIVIAL(trace) << "Got signal: " << sig_code << "; stopping...";
-      if (ec)
-      {
-        BOOST_LOG_TRIVIAL(error) << "Error: " << ec.message();
-      }
+    if (options.get_profile())
+    {
+      mpegts::enable_profiling();
+    }
+
+    // statistics are always counted, SIGUSR1 logs them
+    auto stats = std::make_unique<mpegts::stats_exporter>(options.get_stats_exporter_settings());
 
-      svc.stop();
-    });
+    asio::io_context signal_handling_ctx;
+    asio::signal_set stats_signal(signal_handling_ctx, SIGUSR1);
+    log_stats_on_signal(stats_signal, *stats);
 
-    svc.start();
+    const auto &input_files = options.get_input_file_names();
+    int ret = 0;
 
-    int ret = signal_handling_ctx.run();
-    svc.join();
+    if (input_files.size() == 1)
+    {
+      mpegts::demux_service svc(input_files.front(), signal_handling_ctx,
+          make_file_writer(
+              options.get_oputput_directory(), options.get_file_writer_settings()),
+          options.get_demux_settings());
+      ret = run(svc, signal_handling_ctx);
+    }
+    else
+    {
+      auto output_dirs = make_output_dirs(input_files, options.get_oputput_directory());
+      mpegts::batch_demux_service svc(input_files, signal_handling_ctx,
+          [&output_dirs, &options](size_t file_index) {
+            return make_file_writer(output_dirs[file_index], options.get_file_writer_settings());
+          },
+          options.get_jobs(), options.get_demux_settings());
+      ret = run(svc, signal_handling_ctx);
+    }
 
+    stats.reset();
+    if (options.get_profile())
+    {
+      std::cout << mpegts::profiling_report();
+    }
+    logger::stop_packet_trace();
     BOOST_LOG_TRIVIAL(info) << "Exiting...";
+    logger::shutdown();
 
     return ret;
   }
   catch (const std::exception &e)
   {
+    logger::shutdown();
     std::cerr << e.what() << std::endl;
     return 1;
   }
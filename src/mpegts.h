@@ -22,6 +22,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <vector> // Minor: unused
 
@@ -36,9 +37,30 @@ struct buffer_slice
 struct pes_packet_t
 {
   uint16_t pid;
+  // stream_type from PMT, 0 if the stream isn't listed in any PMT seen so far
+  uint8_t stream_type;
   buffer_slice payload;
 };
 
 using packet_received_callback_t = std::function<void(const pes_packet_t &)>;
 
+// PES completed together, ordered by PID and by arrival within a PID;
+// valid only during the callback
+struct pes_batch_t
+{
+  const pes_packet_t *packets;
+  size_t count;
+
+  const pes_packet_t *begin() const
+  {
+    return packets;
+  }
+  const pes_packet_t *end() const
+  {
+    return packets + count;
+  }
+};
+
+using batch_received_callback_t = std::function<void(const pes_batch_t &)>;
+
 } // namespace mpegts
@@ -22,8 +22,16 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #include "options.h"
 #include "logger.h"
+#include "profiling.h"
+#include "utils.hpp"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <sched.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -34,23 +42,150 @@ namespace po = boost::program_options;
 namespace log = boost::log;
 namespace fs = boost::filesystem;
 
+namespace
+{
+// lists can be given as separate tokens or comma separated, in decimal or 0x hex
+template <typename T>
+std::vector<T> parse_list(
+    const std::vector<std::string> &values, const char *option, unsigned long max_value)
+{
+  std::vector<T> result;
+
+  for (const auto &value : values)
+  {
+    std::istringstream iss(value);
+    std::string token;
+    while (std::getline(iss, token, ','))
+    {
+      if (token.empty())
+      {
+        continue;
+      }
+      size_t pos = 0;
+      unsigned long number = 0;
+      try
+      {
+        number = std::stoul(token, &pos, 0);
+      }
+      catch (const std::exception &)
+      {
+        pos = 0;
+      }
+      if (pos != token.size() || number > max_value)
+      {
+        throw po::validation_error(
+            po::validation_error::invalid_option_value, option, token);
+      }
+      result.push_back(static_cast<T>(number));
+    }
+  }
+  return result;
+}
+
+template <typename T>
+std::string list_to_string(const std::vector<T> &values, const char *if_empty, bool is_hex)
+{
+  std::string result;
+  for (auto value : values)
+  {
+    result += (result.empty() ? "" : ",") +
+              (is_hex ? utils::num_to_hex(value, true) : std::to_string(value));
+  }
+  return result.empty() ? if_empty : result;
+}
+
+// one input file per line, blank lines and lines starting with '#' are skipped
+std::vector<std::string> read_manifest(const std::string &manifest)
+{
+  std::ifstream ifs(manifest);
+  if (!ifs)
+  {
+    throw po::error("can't open manifest " + manifest);
+  }
+
+  std::vector<std::string> result;
+  std::string line;
+  while (std::getline(ifs, line))
+  {
+    const auto begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+    {
+      continue;
+    }
+    const auto end = line.find_last_not_of(" \t\r");
+    result.push_back(line.substr(begin, end - begin + 1));
+  }
+  return result;
+}
+} // namespace
+
 bool options::parse(int argc, char *argv[])
 {
   po::options_description desc("Options");
   bool log_ts_packets;
   bool log_pes_packets;
+  std::vector<std::string> pids;
+  std::vector<std::string> exclude_pids;
+  std::vector<std::string> cpus;
+  std::string manifest;
+  size_t write_buffer_kb;
+  size_t preallocate_mb;
+  size_t udp_receive_buffer_kb;
+  size_t max_latency_ms;
+  size_t stats_interval_ms;
 
   using log::trivial::severity_level;
 
   desc.add_options()("help", "produce help message")(
       "output_dir,o", po::value(&_output_dir), "output directory")("log_level,l",
       po::value<severity_level>(&_log_level)->default_value(severity_level::info),
-      "log level [trace, debug, info, warning, error, fatal]")("log_ts_packets",
-      po::bool_switch(&log_ts_packets)->default_value(false), "log TS packets")("log_pes_packets",
-      po::bool_switch(&log_pes_packets)->default_value(false), "log PES packets");
+      "log level [trace, debug, info, warning, error, fatal]")("input_mode,m",
+      po::value<input_mode>(&_demux_settings.mode)->default_value(input_mode::mmap),
+      "input mode [mmap, stream, uring]")("pids",
+      po::value(&pids)->multitoken(), "demux only these PIDs, e.g. 0x100,0x101")("exclude_pids",
+      po::value(&exclude_pids)->multitoken(), "never demux these PIDs")("workers",
+      po::value(&_demux_settings.workers)->default_value(0),
+      "PES reassembly threads, 0 demuxes on the reading thread")("writers",
+      po::value(&_demux_settings.writers)->default_value(1),
+      "output writing threads, used with workers")("cpus", po::value(&cpus)->multitoken(),
+      "CPUs to pin reading, worker and writer threads to, in that order")("chunk_threads",
+      po::value(&_demux_settings.chunk_threads)->default_value(0),
+      "threads demuxing the file as independent byte ranges, 0 reads it sequentially")(
+      "manifest", po::value(&manifest), "file listing input files, one per line")("jobs,j",
+      po::value(&_jobs)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+      "input files demuxed at a time when there are several")("write_buffer",
+      po::value(&write_buffer_kb)->default_value(_writer_settings.buffer_size / 1024),
+      "output buffer of each PID in KiB")("write_queue",
+      po::value(&_writer_settings.queue_depth)->default_value(_writer_settings.queue_depth),
+      "full output buffers waiting to be written before demuxing blocks")("preallocate",
+      po::value(&preallocate_mb)->default_value(0),
+      "disk space in MiB reserved ahead of output data, 0 reserves none")("direct_io",
+      po::bool_switch(&_writer_settings.direct_io)->default_value(false),
+      "write output with O_DIRECT")("max_latency",
+      po::value(&max_latency_ms)->default_value(0),
+      "longest time in ms output waits in a buffer, 0 writes full buffers only")("udp_rcvbuf",
+      po::value(&udp_receive_buffer_kb)
+          ->default_value(_demux_settings.udp_receive_buffer / 1024),
+      "socket receive buffer in KiB for udp:// and rtp:// inputs")("log_ts_packets",
+      po::bool_switch(&log_ts_packets)->default_value(false),
+      "write TS packets to the packet trace")("log_pes_packets",
+      po::bool_switch(&log_pes_packets)->default_value(false),
+      "write PES packets to the packet trace")("trace_file",
+      po::value(&_trace_file)->default_value("mpeg-ts-demux_%Y%m%d_%H%M%S.trace"),
+      "binary packet trace file, decoded by mpeg-ts-trace-decode")("trace_ring",
+      po::value(&_trace_ring_size)->default_value(64 * 1024),
+      "packet trace records buffered per thread, more are dropped")("stats_file",
+      po::value(&_stats_settings.json_file), "JSON statistics file replaced every interval")(
+      "stats_socket", po::value(&_stats_settings.socket_path),
+      "Unix socket serving statistics in Prometheus text format")("stats_interval",
+      po::value(&stats_interval_ms)->default_value(_stats_settings.interval.count()),
+      "statistics update interval in ms")("profile",
+      po::bool_switch(&_profile)->default_value(false),
+      "print time spent per demuxing stage and PID on exit");
 
   auto print_help = [&]() {
-    std::cout << "Usage: " << argv[0] << " [options] <input_file_name>"
+    std::cout << "Usage: " << argv[0]
+              << " [options] <input_file_name | - | udp://[source@]address:port | rtp://...>..."
               << "\n"
               << desc;
   };
@@ -66,7 +201,7 @@ bool options::parse(int argc, char *argv[])
   }
 
   po::options_description hidden_desc("Hidden options");
-  hidden_desc.add_options()("input", po::value(&_input_file)->required());
+  hidden_desc.add_options()("input", po::value(&_input_files));
 
   // Desc for parsing
   po::options_description parsing_desc;
@@ -78,16 +213,66 @@ bool options::parse(int argc, char *argv[])
   parsed = po::command_line_parser(argc, argv).options(parsing_desc).positional(pos).run();
 
   po::store(parsed, vm);
+  po::notify(vm);
+  logger::log_ts_packets = log_ts_packets;
+  logger::log_pes_packets = log_pes_packets;
+
   try
   {
-    po::notify(vm);
-    logger::log_ts_packets = log_ts_packets;
-    logger::log_pes_packets = log_pes_packets;
+    if (!manifest.empty())
+    {
+      const auto files = read_manifest(manifest);
+      _input_files.insert(_input_files.end(), files.begin(), files.end());
+    }
+    if (_input_files.empty())
+    {
+      throw po::error("input is required");
+    }
+    if (!_jobs)
+    {
+      throw po::validation_error(po::validation_error::invalid_option_value, "--jobs", "0");
+    }
+    if (!write_buffer_kb)
+    {
+      throw po::validation_error(po::validation_error::invalid_option_value, "--write_buffer", "0");
+    }
+    if (!_writer_settings.queue_depth)
+    {
+      throw po::validation_error(po::validation_error::invalid_option_value, "--write_queue", "0");
+    }
+    if (!_trace_ring_size)
+    {
+      throw po::validation_error(po::validation_error::invalid_option_value, "--trace_ring", "0");
+    }
+    if (!stats_interval_ms)
+    {
+      throw po::validation_error(
+          po::validation_error::invalid_option_value, "--stats_interval", "0");
+    }
+    _stats_settings.interval = std::chrono::milliseconds(stats_interval_ms);
+    if (_profile && !profiling_supported())
+    {
+      throw po::error("--profile needs a build with MPEGTS_PROFILING");
+    }
+    _demux_settings.udp_receive_buffer = udp_receive_buffer_kb * 1024;
+    _writer_settings.buffer_size = write_buffer_kb * 1024;
+    _writer_settings.preallocate_size = preallocate_mb * 1024 * 1024;
+    _writer_settings.max_latency = std::chrono::milliseconds(max_latency_ms);
+    _demux_settings.pids = parse_list<uint16_t>(pids, "--pids", 0x1fff);
+    _demux_settings.exclude_pids = parse_list<uint16_t>(exclude_pids, "--exclude_pids", 0x1fff);
+    _demux_settings.cpus = parse_list<int>(cpus, "--cpus", CPU_SETSIZE - 1);
+    if (_demux_settings.workers && !_demux_settings.writers)
+    {
+      throw po::validation_error(po::validation_error::invalid_option_value, "--writers", "0");
+    }
+    if (_demux_settings.workers && _demux_settings.chunk_threads)
+    {
+      throw po::error("--workers and --chunk_threads can't be used together");
+    }
   }
-  catch (const po::error &)
+  catch (const po::error &e)
   {
-    std::cerr << "Error: input is required"
-              << "\n";
+    std::cerr << "Error: " << e.what() << "\n";
     print_help();
     return false;
   }
@@ -100,9 +285,9 @@ bool options::parse(int argc, char *argv[])
   return true;
 }
 
-const std::string &options::get_input_file_name() const
+const std::vector<std::string> &options::get_input_file_names() const
 {
-  return _input_file;
+  return _input_files;
 }
 const std::string &options::get_oputput_directory() const
 {
@@ -114,13 +299,114 @@ boost::log::trivial::severity_level options::get_log_severity_level() const
   return _log_level;
 }
 
+const demux_settings &options::get_demux_settings() const
+{
+  return _demux_settings;
+}
+
+size_t options::get_jobs() const
+{
+  return _jobs;
+}
+
+const file_writer_settings &options::get_file_writer_settings() const
+{
+  return _writer_settings;
+}
+
+const std::string &options::get_trace_file_name() const
+{
+  return _trace_file;
+}
+
+size_t options::get_trace_ring_size() const
+{
+  return _trace_ring_size;
+}
+
+const stats_exporter_settings &options::get_stats_exporter_settings() const
+{
+  return _stats_settings;
+}
+
+bool options::get_profile() const
+{
+  return _profile;
+}
+
 void options::print() const
 {
-  BOOST_LOG_TRIVIAL(info) << "Input file name: " << _input_file;
+  for (const auto &input_file : _input_files)
+  {
+    BOOST_LOG_TRIVIAL(info) << "Input file name: " << input_file;
+  }
   BOOST_LOG_TRIVIAL(info) << "Output directory: " << _output_dir;
   BOOST_LOG_TRIVIAL(info) << "Log level: " << _log_level;
+  BOOST_LOG_TRIVIAL(info) << "Input mode: " << _demux_settings.mode;
+  BOOST_LOG_TRIVIAL(info) << "PIDs: " << list_to_string(_demux_settings.pids, "all", true);
+  BOOST_LOG_TRIVIAL(info) << "Excluded PIDs: "
+                          << list_to_string(_demux_settings.exclude_pids, "none", true);
+  BOOST_LOG_TRIVIAL(info) << "Workers: " << _demux_settings.workers;
+  BOOST_LOG_TRIVIAL(info) << "Writers: " << _demux_settings.writers;
+  BOOST_LOG_TRIVIAL(info) << "Chunk threads: " << _demux_settings.chunk_threads;
+  BOOST_LOG_TRIVIAL(info) << "Jobs: " << _jobs;
+  BOOST_LOG_TRIVIAL(info) << "Write buffer: " << _writer_settings.buffer_size / 1024 << " KiB";
+  BOOST_LOG_TRIVIAL(info) << "Write queue: " << _writer_settings.queue_depth;
+  BOOST_LOG_TRIVIAL(info) << "Preallocate: " << _writer_settings.preallocate_size / (1024 * 1024)
+                          << " MiB";
+  BOOST_LOG_TRIVIAL(info) << "Direct IO: " << _writer_settings.direct_io;
+  BOOST_LOG_TRIVIAL(info) << "Max latency: " << _writer_settings.max_latency.count() << " ms";
+  BOOST_LOG_TRIVIAL(info) << "UDP receive buffer: " << _demux_settings.udp_receive_buffer / 1024
+                          << " KiB";
+  BOOST_LOG_TRIVIAL(info) << "CPUs: " << list_to_string(_demux_settings.cpus, "none", false);
+  BOOST_LOG_TRIVIAL(info) << "Stats file: " << _stats_settings.json_file;
+  BOOST_LOG_TRIVIAL(info) << "Stats socket: " << _stats_settings.socket_path;
+  BOOST_LOG_TRIVIAL(info) << "Stats interval: " << _stats_settings.interval.count() << " ms";
+  BOOST_LOG_TRIVIAL(info) << "Profile: " << _profile;
   BOOST_LOG_TRIVIAL(info) << "Log TS packets: " << logger::log_ts_packets;
   BOOST_LOG_TRIVIAL(info) << "Log PES packets: " << logger::log_pes_packets;
+  if (logger::log_ts_packets || logger::log_pes_packets)
+  {
+    BOOST_LOG_TRIVIAL(info) << "Trace ring: " << _trace_ring_size << " records";
+  }
+}
+
+std::istream &operator>>(std::istream &is, input_mode &mode)
+{
+  std::string value;
+  is >> value;
+
+  if (value == "mmap")
+  {
+    mode = input_mode::mmap;
+  }
+  else if (value == "stream")
+  {
+    mode = input_mode::stream;
+  }
+  else if (value == "uring")
+  {
+    mode = input_mode::uring;
+  }
+  else
+  {
+    is.setstate(std::ios::failbit);
+  }
+  return is;
+}
+
+std::ostream &operator<<(std::ostream &os, input_mode mode)
+{
+  switch (mode)
+  {
+    case input_mode::mmap:
+      return os << "mmap";
+    case input_mode::stream:
+      return os << "stream";
+    case input_mode::uring:
+      return os << "uring";
+  }
+  return os;
 }
 
 } // namespace mpegts
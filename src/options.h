@@ -22,8 +22,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 
 #pragma once
 
+#include "demux_service.h"
+#include "pes_file_writer.h"
+#include "stats_exporter.h"
+
 #include <boost/log/trivial.hpp>
+#include <iosfwd>
 #include <string>
+#include <vector>
 
 namespace mpegts
 {
@@ -32,15 +38,32 @@ class options
 public:
   bool parse(int argc, char *argv[]);
 
-  const std::string &get_input_file_name() const;
+  const std::vector<std::string> &get_input_file_names() const;
   const std::string &get_oputput_directory() const;
   boost::log::trivial::severity_level get_log_severity_level() const;
+  const demux_settings &get_demux_settings() const;
+  size_t get_jobs() const;
+  const file_writer_settings &get_file_writer_settings() const;
+  const std::string &get_trace_file_name() const;
+  size_t get_trace_ring_size() const;
+  const stats_exporter_settings &get_stats_exporter_settings() const;
+  bool get_profile() const;
 
   void print() const;
 
 private:
-  std::string _input_file;
+  std::vector<std::string> _input_files;
   std::string _output_dir;
   boost::log::trivial::severity_level _log_level;
+  demux_settings _demux_settings;
+  size_t _jobs;
+  file_writer_settings _writer_settings;
+  std::string _trace_file;
+  size_t _trace_ring_size;
+  stats_exporter_settings _stats_settings;
+  bool _profile;
 };
+
+std::istream &operator>>(std::istream &is, input_mode &mode);
+std::ostream &operator<<(std::ostream &os, input_mode mode);
 } // namespace mpegts
@@ -0,0 +1,552 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "pes_file_writer.h"
+#include "stream_type.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace
+{
+std::system_error make_error(int error, const std::string &what)
+{
+  return std::system_error(error, std::generic_category(), what);
+}
+
+// pwritev() until everything is written, iov is consumed on the way
+void write_all(int fd, iovec *iov, int count, uint64_t offset)
+{
+  while (count)
+  {
+    ssize_t written = ::pwritev(fd, iov, count, static_cast<off_t>(offset));
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      throw make_error(errno, "pwritev");
+    }
+
+    offset += static_cast<uint64_t>(written);
+    while (count && static_cast<size_t>(written) >= iov->iov_len)
+    {
+      written -= static_cast<ssize_t>(iov->iov_len);
+      ++iov;
+      --count;
+    }
+    if (count)
+    {
+      iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + written;
+      iov->iov_len -= static_cast<size_t>(written);
+    }
+  }
+}
+} // namespace
+
+class pes_file_writer::impl
+{
+public:
+  impl(std::string output_dir, file_writer_settings settings)
+      : _output_dir(std::move(output_dir)), _settings(std::move(settings))
+  {
+    _settings.buffer_size =
+        std::max<size_t>(1, (_settings.buffer_size + DIRECT_IO_ALIGNMENT - 1) /
+                                DIRECT_IO_ALIGNMENT) *
+        DIRECT_IO_ALIGNMENT;
+    _settings.queue_depth = std::max<size_t>(1, _settings.queue_depth);
+    _preallocate = _settings.preallocate_size != 0;
+    if (_settings.max_latency.count())
+    {
+      // data is at most a check interval older than max_latency when written
+      _check_interval = std::max<clock::duration>(
+          _settings.max_latency / 2, std::chrono::milliseconds(1));
+    }
+
+    _thread = std::thread([this]() { run(); });
+  }
+
+  ~impl()
+  {
+    try
+    {
+      close();
+    }
+    catch (const std::exception &e)
+    {
+      BOOST_LOG_TRIVIAL(error) << "Failed to write output to " << _output_dir << ": " << e.what();
+    }
+  }
+
+  void write(const pes_packet_t &packet)
+  {
+    check_failed();
+
+    file_t &file = get_file(packet);
+    std::lock_guard<std::mutex> lock(file.mutex);
+    append(file, packet);
+  }
+
+  void write(const pes_batch_t &batch)
+  {
+    check_failed();
+
+    // PES of a PID are adjacent in a batch, the file is looked up and locked once for them
+    for (auto it = batch.begin(); it != batch.end();)
+    {
+      file_t &file = get_file(*it);
+      std::lock_guard<std::mutex> lock(file.mutex);
+      const uint16_t pid = it->pid;
+      for (; it != batch.end() && it->pid == pid; ++it)
+      {
+        append(file, *it);
+      }
+    }
+  }
+
+  void close()
+  {
+    if (!_thread.joinable())
+    {
+      return;
+    }
+
+    try
+    {
+      std::lock_guard<std::mutex> lock(_files_mutex);
+      for (auto &item : _files)
+      {
+        if (item.second->length)
+        {
+          submit(*item.second, true);
+        }
+      }
+    }
+    catch (const std::exception &)
+    {
+      // the writer thread failed, its error is rethrown once it is joined
+    }
+    {
+      std::lock_guard<std::mutex> lock(_queue_mutex);
+      _closing = true;
+    }
+    _queue_not_empty.notify_one();
+    _thread.join();
+
+    for (auto &item : _files)
+    {
+      ::close(item.second->fd);
+    }
+    _files.clear();
+
+    if (_error)
+    {
+      std::rethrow_exception(_error);
+    }
+  }
+
+private:
+  using buffer_ptr = std::unique_ptr<uint8_t, void (*)(void *)>;
+  using clock = std::chrono::steady_clock;
+
+  struct file_t
+  {
+    // held by the thread writing the PID, tried by the writer thread to write early
+    std::mutex mutex;
+    int fd = -1;
+    buffer_ptr buffer{nullptr, &std::free};
+    // bytes in buffer
+    size_t length = 0;
+    // file offset of the buffer start
+    uint64_t offset = 0;
+    // when the oldest byte in buffer arrived, set with max_latency only
+    clock::time_point first_write;
+    // end of the reserved disk space, used by the writer thread only
+    uint64_t allocated = 0;
+  };
+
+  struct write_request_t
+  {
+    file_t *file;
+    buffer_ptr buffer;
+    size_t length;
+    uint64_t offset;
+    // last write to the file, its length isn't aligned for O_DIRECT
+    bool is_tail;
+  };
+
+  const std::string _output_dir;
+  file_writer_settings _settings;
+
+  std::mutex _files_mutex;
+  std::unordered_map<uint16_t, std::unique_ptr<file_t>> _files;
+
+  std::mutex _queue_mutex;
+  std::condition_variable _queue_not_empty;
+  std::condition_variable _queue_not_full;
+  std::deque<write_request_t> _queue;
+  std::vector<buffer_ptr> _free_buffers;
+  bool _closing = false;
+  std::exception_ptr _error;
+  std::atomic<bool> _failed{false};
+
+  // writer thread only
+  bool _preallocate;
+  // 0 unless max_latency is set
+  clock::duration _check_interval{0};
+  clock::time_point _next_check;
+
+  std::thread _thread;
+
+  void check_failed()
+  {
+    if (_failed)
+    {
+      std::lock_guard<std::mutex> lock(_queue_mutex);
+      std::rethrow_exception(_error);
+    }
+  }
+
+  // file.mutex is held by the caller
+  void append(file_t &file, const pes_packet_t &packet)
+  {
+    const uint8_t *data = packet.payload.data;
+    size_t remaining = packet.payload.length;
+    while (remaining)
+    {
+      if (!file.length && _check_interval.count())
+      {
+        file.first_write = clock::now();
+      }
+
+      const size_t length = std::min(remaining, _settings.buffer_size - file.length);
+      std::memcpy(file.buffer.get() + file.length, data, length);
+      file.length += length;
+      data += length;
+      remaining -= length;
+
+      if (file.length == _settings.buffer_size)
+      {
+        submit(file, false);
+      }
+    }
+  }
+
+  file_t &get_file(const pes_packet_t &packet)
+  {
+    std::lock_guard<std::mutex> lock(_files_mutex);
+    auto it = _files.find(packet.pid);
+    if (it != _files.end())
+    {
+      return *it->second;
+    }
+
+    // named by PID, with codec extension once PMT tells the stream type
+    std::string file_name = utils::num_to_hex(packet.pid, true);
+    if (const char *extension = get_stream_type_extension(packet.stream_type))
+    {
+      file_name = file_name + "." + extension;
+    }
+    const auto path = (boost::filesystem::path(_output_dir) / file_name).string();
+
+    auto file = std::make_unique<file_t>();
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (_settings.direct_io)
+    {
+      file->fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      if (file->fd < 0 && errno == EINVAL)
+      {
+        BOOST_LOG_TRIVIAL(warning) << "O_DIRECT is not supported for " << path
+                                   << ", writing through the page cache";
+      }
+    }
+    if (file->fd < 0)
+    {
+      file->fd = ::open(path.c_str(), flags, 0644);
+    }
+    if (file->fd < 0)
+    {
+      throw make_error(errno, "Failed to open " + path);
+    }
+
+    file->buffer = acquire_buffer();
+    return *_files.emplace(packet.pid, std::move(file)).first->second;
+  }
+
+  buffer_ptr acquire_buffer()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_queue_mutex);
+      if (!_free_buffers.empty())
+      {
+        buffer_ptr buffer = std::move(_free_buffers.back());
+        _free_buffers.pop_back();
+        return buffer;
+      }
+    }
+
+    void *memory = nullptr;
+    if (int error = ::posix_memalign(&memory, DIRECT_IO_ALIGNMENT, _settings.buffer_size))
+    {
+      throw make_error(error, "Failed to allocate write buffer");
+    }
+    return buffer_ptr(static_cast<uint8_t *>(memory), &std::free);
+  }
+
+  // hands the file buffer to the writer thread, waits while the queue is full
+  void submit(file_t &file, bool is_tail)
+  {
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      _queue_not_full.wait(
+          lock, [this]() { return _queue.size() < _settings.queue_depth || _error; });
+      if (_error)
+      {
+        std::rethrow_exception(_error);
+      }
+      _queue.push_back({&file, std::move(file.buffer), file.length, file.offset, is_tail});
+    }
+    _queue_not_empty.notify_one();
+
+    file.offset += file.length;
+    file.length = 0;
+    if (!is_tail)
+    {
+      file.buffer = acquire_buffer();
+    }
+  }
+
+  void run()
+  {
+    std::vector<write_request_t> batch;
+
+    for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(_queue_mutex);
+        auto ready = [this]() { return !_queue.empty() || _closing; };
+        if (_check_interval.count())
+        {
+          _queue_not_empty.wait_until(lock, _next_check, ready);
+        }
+        else
+        {
+          _queue_not_empty.wait(lock, ready);
+        }
+        if (_queue.empty() && _closing)
+        {
+          break;
+        }
+        batch.assign(
+            std::make_move_iterator(_queue.begin()), std::make_move_iterator(_queue.end()));
+        _queue.clear();
+      }
+      _queue_not_full.notify_all();
+
+      try
+      {
+        if (!_failed)
+        {
+          write_batch(batch);
+        }
+        if (!_failed && _check_interval.count() && clock::now() >= _next_check)
+        {
+          write_old_buffers();
+          _next_check = clock::now() + _check_interval;
+        }
+      }
+      catch (const std::exception &)
+      {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _error = std::current_exception();
+        _failed = true;
+      }
+      _queue_not_full.notify_all();
+
+      std::lock_guard<std::mutex> lock(_queue_mutex);
+      for (auto &request : batch)
+      {
+        _free_buffers.push_back(std::move(request.buffer));
+      }
+      batch.clear();
+    }
+  }
+
+  // buffers of one file which follow each other on disk go out in a single pwritev()
+  void write_batch(std::vector<write_request_t> &batch)
+  {
+    std::stable_sort(batch.begin(), batch.end(), [](const auto &lhs, const auto &rhs) {
+      return lhs.file < rhs.file || (lhs.file == rhs.file && lhs.offset < rhs.offset);
+    });
+
+    std::vector<iovec> iov;
+    for (size_t begin = 0; begin < batch.size();)
+    {
+      const auto &first = batch[begin];
+      uint64_t end = first.offset;
+      iov.clear();
+
+      size_t next = begin;
+      for (; next < batch.size() && iov.size() < IOV_MAX; ++next)
+      {
+        auto &request = batch[next];
+        if (request.file != first.file || request.offset != end)
+        {
+          break;
+        }
+        iov.push_back({request.buffer.get(), request.length});
+        end += request.length;
+      }
+
+      if (batch[next - 1].is_tail)
+      {
+        disable_direct_io(*first.file);
+      }
+
+      preallocate(*first.file, end);
+      write_all(first.file->fd, iov.data(), static_cast<int>(iov.size()), first.offset);
+      begin = next;
+    }
+  }
+
+  // writes buffers holding data older than max_latency; files busy in write() are left for
+  // the next check, the thread writing them is not kept waiting
+  void write_old_buffers()
+  {
+    std::unique_lock<std::mutex> files_lock(_files_mutex, std::try_to_lock);
+    if (!files_lock)
+    {
+      return;
+    }
+
+    const auto now = clock::now();
+    for (auto &item : _files)
+    {
+      file_t &file = *item.second;
+      std::unique_lock<std::mutex> lock(file.mutex, std::try_to_lock);
+      if (!lock || !file.length || now - file.first_write < _settings.max_latency)
+      {
+        continue;
+      }
+
+      buffer_ptr buffer = acquire_buffer();
+      std::swap(buffer, file.buffer);
+      const size_t length = file.length;
+      const uint64_t offset = file.offset;
+      file.offset += length;
+      file.length = 0;
+      lock.unlock();
+
+      disable_direct_io(file);
+      preallocate(file, offset + length);
+      iovec iov{buffer.get(), length};
+      write_all(file.fd, &iov, 1, offset);
+
+      std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+      _free_buffers.push_back(std::move(buffer));
+    }
+  }
+
+  // O_DIRECT needs aligned lengths and offsets, the file goes through the page cache from now
+  void disable_direct_io(file_t &file)
+  {
+    if (!_settings.direct_io)
+    {
+      return;
+    }
+    const int flags = ::fcntl(file.fd, F_GETFL);
+    if (flags >= 0 && (flags & O_DIRECT))
+    {
+      ::fcntl(file.fd, F_SETFL, flags & ~O_DIRECT);
+    }
+  }
+
+  void preallocate(file_t &file, uint64_t end)
+  {
+    if (!_preallocate || end <= file.allocated)
+    {
+      return;
+    }
+
+    const uint64_t step = _settings.preallocate_size;
+    const uint64_t allocated = (end + step - 1) / step * step;
+    if (::fallocate(file.fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(file.allocated),
+            static_cast<off_t>(allocated - file.allocated)) < 0)
+    {
+      if (errno != EOPNOTSUPP)
+      {
+        throw make_error(errno, "fallocate");
+      }
+      BOOST_LOG_TRIVIAL(warning) << "fallocate is not supported, disk space is not reserved";
+      _preallocate = false;
+      return;
+    }
+    file.allocated = allocated;
+  }
+};
+
+pes_file_writer::pes_file_writer(std::string output_dir, file_writer_settings settings)
+    : _impl(std::make_unique<impl>(std::move(output_dir), std::move(settings)))
+{
+}
+
+pes_file_writer::~pes_file_writer()
+{
+}
+
+void pes_file_writer::write(const pes_packet_t &packet)
+{
+  _impl->write(packet);
+}
+
+void pes_file_writer::write(const pes_batch_t &batch)
+{
+  _impl->write(batch);
+}
+
+void pes_file_writer::close()
+{
+  _impl->close();
+}
+} // namespace mpegts
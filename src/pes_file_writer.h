@@ -0,0 +1,74 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include "mpegts.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace mpegts
+{
+struct file_writer_settings
+{
+  // write-behind buffer of each PID, rounded up to pes_file_writer::DIRECT_IO_ALIGNMENT
+  size_t buffer_size = 1024 * 1024;
+  // filled buffers waiting for the writer thread, write() blocks once there are that many
+  size_t queue_depth = 16;
+  // disk space reserved ahead of the written data with fallocate(), 0 reserves none
+  size_t preallocate_size = 0;
+  // whole buffers bypass the page cache with O_DIRECT, the tail of each file does not
+  bool direct_io = false;
+  // longest time data waits in a buffer before being written, 0 waits for a full buffer;
+  // a file written early drops O_DIRECT, since its offsets are no longer aligned
+  std::chrono::milliseconds max_latency{0};
+};
+
+// writes PES payloads of every PID to <output_dir>/<PID>[.<codec extension>];
+// payloads are gathered in large per-PID buffers which a dedicated thread writes with
+// pwritev(), so demuxing only waits for the disk once queue_depth buffers are pending
+class pes_file_writer
+{
+public:
+  static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+  explicit pes_file_writer(std::string output_dir, file_writer_settings settings = {});
+  // closes the writer, errors are logged
+  ~pes_file_writer();
+  pes_file_writer(const pes_file_writer &) = delete;
+  pes_file_writer &operator=(const pes_file_writer &) = delete;
+
+  // may be called from several threads as long as a PID is always written from the same one;
+  // throws if an earlier write failed
+  void write(const pes_packet_t &packet);
+  // same for a batch, each PID's file is looked up once per run of its PES
+  void write(const pes_batch_t &batch);
+  // writes out everything buffered and closes the files, throws if any write failed
+  void close();
+
+private:
+  class impl;
+  std::unique_ptr<impl> _impl;
+};
+} // namespace mpegts
@@ -0,0 +1,58 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "profiling.h"
+#include "detail/profiler.h"
+
+#include <stdexcept>
+
+namespace mpegts
+{
+bool profiling_supported()
+{
+#ifdef MPEGTS_PROFILING
+  return true;
+#else
+  return false;
+#endif
+}
+
+void enable_profiling()
+{
+#ifdef MPEGTS_PROFILING
+  detail::profiling::enable();
+#else
+  throw std::logic_error("built without MPEGTS_PROFILING");
+#endif
+}
+
+std::string profiling_report()
+{
+#ifdef MPEGTS_PROFILING
+  if (detail::profiling::is_enabled())
+  {
+    return detail::profiling::report();
+  }
+#endif
+  return {};
+}
+} // namespace mpegts
@@ -0,0 +1,194 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "stats.h"
+#include "detail/mpegts_detail.h"
+#include "detail/stats_counters.h"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace mpegts
+{
+namespace
+{
+std::chrono::steady_clock::time_point start_time;
+
+void add_pid_counters(const detail::stats::pid_counters &counters, pid_stats &stats)
+{
+  stats.packets += counters.packets.get();
+  stats.pes_packets += counters.pes_packets.get();
+  stats.pes_bytes += counters.pes_bytes.get();
+  stats.max_pes_size = std::max(stats.max_pes_size, counters.max_pes_size.get());
+  stats.cc_errors += counters.cc_errors.get();
+  stats.tei_drops += counters.tei_drops.get();
+  stats.non_pes_skipped += counters.non_pes_skipped.get();
+}
+
+// one Prometheus metric with a sample per PID, value_of(const pid_stats &) gives it
+template <typename F>
+void write_pid_metric(std::ostream &os, const stats_snapshot &snapshot, const char *name,
+    const char *type, const char *help, F &&value_of)
+{
+  os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+  for (const auto &pid : snapshot.pids)
+  {
+    os << name << "{pid=\"" << utils::num_to_hex(pid.first, true) << "\"} "
+       << value_of(pid.second) << "\n";
+  }
+}
+
+template <typename T>
+void write_metric(
+    std::ostream &os, const char *name, const char *type, const char *help, T value)
+{
+  os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n"
+     << name << " " << value << "\n";
+}
+} // namespace
+
+void enable_stats()
+{
+  if (!detail::stats::is_enabled())
+  {
+    start_time = std::chrono::steady_clock::now();
+    detail::stats::enable();
+  }
+}
+
+bool stats_enabled()
+{
+  return detail::stats::is_enabled();
+}
+
+stats_snapshot take_stats_snapshot(const stats_snapshot *previous)
+{
+  stats_snapshot snapshot;
+
+  snapshot.elapsed_seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  detail::stats::for_each_thread([&snapshot](const detail::stats::thread_counters &counters) {
+    snapshot.packets += counters.packets.get();
+    snapshot.skipped_bytes += counters.skipped_bytes.get();
+
+    for (uint16_t pid = 0; pid < detail::PID_COUNT; ++pid)
+    {
+      if (const auto *pid_counters = counters.find_pid(pid))
+      {
+        add_pid_counters(*pid_counters, snapshot.pids[pid]);
+      }
+    }
+  });
+
+  snapshot.bytes = snapshot.packets * detail::TS_PACKET_SIZE + snapshot.skipped_bytes;
+  for (auto &pid : snapshot.pids)
+  {
+    pid.second.bytes = pid.second.packets * detail::TS_PACKET_SIZE;
+  }
+
+  double seconds = snapshot.elapsed_seconds;
+  uint64_t packets = snapshot.packets;
+  uint64_t bytes = snapshot.bytes;
+  if (previous)
+  {
+    seconds -= previous->elapsed_seconds;
+    packets -= previous->packets;
+    bytes -= previous->bytes;
+  }
+  if (seconds > 0)
+  {
+    snapshot.packets_per_second = packets / seconds;
+    snapshot.megabytes_per_second = bytes / seconds / (1024 * 1024);
+  }
+
+  return snapshot;
+}
+
+std::string to_json(const stats_snapshot &snapshot)
+{
+  std::ostringstream os;
+
+  os << "{\"elapsed_seconds\":" << snapshot.elapsed_seconds
+     << ",\"packets\":" << snapshot.packets << ",\"bytes\":" << snapshot.bytes
+     << ",\"skipped_bytes\":" << snapshot.skipped_bytes
+     << ",\"packets_per_second\":" << snapshot.packets_per_second
+     << ",\"megabytes_per_second\":" << snapshot.megabytes_per_second << ",\"pids\":{";
+
+  const char *separator = "";
+  for (const auto &pid : snapshot.pids)
+  {
+    const auto &stats = pid.second;
+
+    os << separator << "\"" << utils::num_to_hex(pid.first, true)
+       << "\":{\"packets\":" << stats.packets << ",\"bytes\":" << stats.bytes
+       << ",\"pes_packets\":" << stats.pes_packets << ",\"pes_bytes\":" << stats.pes_bytes
+       << ",\"average_pes_size\":" << stats.average_pes_size()
+       << ",\"max_pes_size\":" << stats.max_pes_size << ",\"cc_errors\":" << stats.cc_errors
+       << ",\"tei_drops\":" << stats.tei_drops
+       << ",\"non_pes_skipped\":" << stats.non_pes_skipped << "}";
+    separator = ",";
+  }
+  os << "}}\n";
+
+  return os.str();
+}
+
+std::string to_prometheus(const stats_snapshot &snapshot)
+{
+  std::ostringstream os;
+
+  write_metric(os, "mpegts_packets_total", "counter", "TS packets parsed", snapshot.packets);
+  write_metric(os, "mpegts_input_bytes_total", "counter", "Input bytes", snapshot.bytes);
+  write_metric(os, "mpegts_skipped_bytes_total", "counter",
+      "Input bytes dropped to find TS packet alignment", snapshot.skipped_bytes);
+  write_metric(os, "mpegts_packets_per_second", "gauge", "TS packets parsed per second",
+      snapshot.packets_per_second);
+  write_metric(os, "mpegts_megabytes_per_second", "gauge", "Input MiB per second",
+      snapshot.megabytes_per_second);
+
+  write_pid_metric(os, snapshot, "mpegts_pid_packets_total", "counter", "TS packets of PID",
+      [](const pid_stats &stats) { return stats.packets; });
+  write_pid_metric(os, snapshot, "mpegts_pid_bytes_total", "counter", "TS packet bytes of PID",
+      [](const pid_stats &stats) { return stats.bytes; });
+  write_pid_metric(os, snapshot, "mpegts_pid_pes_packets_total", "counter", "PES of PID",
+      [](const pid_stats &stats) { return stats.pes_packets; });
+  write_pid_metric(os, snapshot, "mpegts_pid_pes_bytes_total", "counter", "PES bytes of PID",
+      [](const pid_stats &stats) { return stats.pes_bytes; });
+  write_pid_metric(os, snapshot, "mpegts_pid_pes_size_average_bytes", "gauge",
+      "Average PES size of PID", [](const pid_stats &stats) { return stats.average_pes_size(); });
+  write_pid_metric(os, snapshot, "mpegts_pid_pes_size_max_bytes", "gauge",
+      "Largest PES of PID", [](const pid_stats &stats) { return stats.max_pes_size; });
+  write_pid_metric(os, snapshot, "mpegts_pid_cc_errors_total", "counter",
+      "Continuity counter errors of PID", [](const pid_stats &stats) { return stats.cc_errors; });
+  write_pid_metric(os, snapshot, "mpegts_pid_tei_drops_total", "counter",
+      "Packets of PID dropped for transport_error_indicator",
+      [](const pid_stats &stats) { return stats.tei_drops; });
+  write_pid_metric(os, snapshot, "mpegts_pid_non_pes_skipped_total", "counter",
+      "PES of PID skipped for a stream_id without media",
+      [](const pid_stats &stats) { return stats.non_pes_skipped; });
+
+  return os.str();
+}
+} // namespace mpegts
@@ -0,0 +1,79 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace mpegts
+{
+struct pid_stats
+{
+  uint64_t packets = 0;
+  // TS packet bytes
+  uint64_t bytes = 0;
+  uint64_t pes_packets = 0;
+  uint64_t pes_bytes = 0;
+  uint64_t max_pes_size = 0;
+  // continuity counter errors, i.e. lost packets
+  uint64_t cc_errors = 0;
+  // packets dropped for transport_error_indicator
+  uint64_t tei_drops = 0;
+  // PES skipped for a stream_id which doesn't carry media
+  uint64_t non_pes_skipped = 0;
+
+  uint64_t average_pes_size() const
+  {
+    return pes_packets ? pes_bytes / pes_packets : 0;
+  }
+};
+
+// counters of all threads and demuxers of the process at one moment
+struct stats_snapshot
+{
+  // since enable_stats()
+  double elapsed_seconds = 0;
+  uint64_t packets = 0;
+  // input bytes, TS packets and skipped bytes
+  uint64_t bytes = 0;
+  // input bytes dropped to find TS packet alignment
+  uint64_t skipped_bytes = 0;
+  // since the previous snapshot, or since enable_stats() for the first one
+  double packets_per_second = 0;
+  double megabytes_per_second = 0;
+  std::map<uint16_t, pid_stats> pids;
+};
+
+// starts counting, demuxing costs a few relaxed stores per packet afterwards; counting
+// can't be stopped
+void enable_stats();
+bool stats_enabled();
+
+// rates are computed over the time since previous when it is given
+stats_snapshot take_stats_snapshot(const stats_snapshot *previous = nullptr);
+
+std::string to_json(const stats_snapshot &snapshot);
+// Prometheus text exposition format
+std::string to_prometheus(const stats_snapshot &snapshot);
+} // namespace mpegts
@@ -0,0 +1,279 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "stats_exporter.h"
+#include "stats.h"
+#include "utils.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace
+{
+// longest wait for a scrape request and for stop()
+constexpr int POLL_TIMEOUT_MS = 100;
+constexpr size_t MAX_REQUEST_SIZE = 4096;
+
+std::system_error make_error(int error, const std::string &what)
+{
+  return std::system_error(error, std::generic_category(), what);
+}
+
+void send_all(int fd, const std::string &data)
+{
+  const char *bytes = data.data();
+  size_t length = data.size();
+
+  while (length)
+  {
+    const ssize_t sent = ::send(fd, bytes, length, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      throw make_error(errno, "send");
+    }
+    bytes += sent;
+    length -= static_cast<size_t>(sent);
+  }
+}
+} // namespace
+
+class stats_exporter::impl
+{
+public:
+  explicit impl(stats_exporter_settings settings) : _settings(std::move(settings))
+  {
+    enable_stats();
+
+    if (!_settings.socket_path.empty())
+    {
+      open_socket();
+    }
+    _latest = take_stats_snapshot();
+    _thread = std::thread([this]() { run(); });
+  }
+
+  ~impl()
+  {
+    _stopping = true;
+    _thread.join();
+
+    update();
+    if (_socket_fd >= 0)
+    {
+      ::close(_socket_fd);
+      ::unlink(_settings.socket_path.c_str());
+    }
+  }
+
+  void log_snapshot()
+  {
+    const auto snapshot = take_current();
+
+    BOOST_LOG_TRIVIAL(info) << "Stats: " << snapshot.packets << " packets, "
+                            << snapshot.packets_per_second << " packets/s, "
+                            << snapshot.megabytes_per_second << " MiB/s, "
+                            << snapshot.skipped_bytes << " bytes skipped";
+    for (const auto &pid : snapshot.pids)
+    {
+      const auto &stats = pid.second;
+      BOOST_LOG_TRIVIAL(info) << "Stats of PID " << utils::num_to_hex(pid.first, true) << ": "
+                              << stats.packets << " packets, " << stats.pes_packets
+                              << " PES of " << stats.average_pes_size() << " bytes on average, "
+                              << stats.max_pes_size << " at most, " << stats.cc_errors
+                              << " CC errors, " << stats.tei_drops << " TEI drops, "
+                              << stats.non_pes_skipped << " non-media PES skipped";
+    }
+  }
+
+private:
+  const stats_exporter_settings _settings;
+  int _socket_fd = -1;
+  std::atomic<bool> _stopping{false};
+  std::thread _thread;
+  bool _json_failed = false;
+
+  // guards _latest, the periodic snapshot, log_snapshot() reads it from other threads
+  std::mutex _mutex;
+  stats_snapshot _latest;
+
+  void open_socket()
+  {
+    sockaddr_un address{};
+    if (_settings.socket_path.size() >= sizeof(address.sun_path))
+    {
+      throw std::invalid_argument("Stats socket path is too long: " + _settings.socket_path);
+    }
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, _settings.socket_path.c_str());
+
+    _socket_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_socket_fd < 0)
+    {
+      throw make_error(errno, "socket");
+    }
+
+    // a socket left behind by an earlier run
+    ::unlink(_settings.socket_path.c_str());
+    if (::bind(_socket_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0 ||
+        ::listen(_socket_fd, SOMAXCONN) < 0)
+    {
+      const int error = errno;
+      ::close(_socket_fd);
+      _socket_fd = -1;
+      throw make_error(error, "Can't listen on " + _settings.socket_path);
+    }
+  }
+
+  // rates of a snapshot are over the time since the last periodic one
+  stats_snapshot take_current()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return take_stats_snapshot(&_latest);
+  }
+
+  stats_snapshot take_periodic()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latest = take_stats_snapshot(&_latest);
+    return _latest;
+  }
+
+  void run()
+  {
+    auto next_update = std::chrono::steady_clock::now() + _settings.interval;
+
+    while (!_stopping)
+    {
+      pollfd fds[1] = {{_socket_fd, POLLIN, 0}};
+      // a negative fd is ignored by poll(), it only waits then
+      if (::poll(fds, 1, POLL_TIMEOUT_MS) > 0 && (fds[0].revents & POLLIN))
+      {
+        serve();
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= next_update)
+      {
+        update();
+        next_update = now + _settings.interval;
+      }
+    }
+  }
+
+  void update()
+  {
+    const auto snapshot = take_periodic();
+
+    if (_settings.json_file.empty() || _json_failed)
+    {
+      return;
+    }
+
+    // readers never see a partly written file
+    const std::string temp_file = _settings.json_file + ".tmp";
+    {
+      std::ofstream ofs(temp_file, std::ios::trunc);
+      ofs << to_json(snapshot);
+      if (!ofs.flush())
+      {
+        BOOST_LOG_TRIVIAL(error) << "Can't write stats to " << temp_file;
+        _json_failed = true;
+        return;
+      }
+    }
+    if (std::rename(temp_file.c_str(), _settings.json_file.c_str()) != 0)
+    {
+      BOOST_LOG_TRIVIAL(error) << "Can't write stats to " << _settings.json_file << ": "
+                               << std::strerror(errno);
+      _json_failed = true;
+    }
+  }
+
+  void serve()
+  {
+    const int fd = ::accept4(_socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+      return;
+    }
+
+    try
+    {
+      // a scraper sends an HTTP request, a plain client may send nothing
+      std::string request(MAX_REQUEST_SIZE, '\0');
+      pollfd fds[1] = {{fd, POLLIN, 0}};
+      ssize_t length = 0;
+      if (::poll(fds, 1, POLL_TIMEOUT_MS) > 0)
+      {
+        length = std::max<ssize_t>(0, ::recv(fd, &request[0], request.size(), 0));
+      }
+      request.resize(static_cast<size_t>(length));
+
+      const std::string body = to_prometheus(take_current());
+      if (request.compare(0, 4, "GET ") == 0)
+      {
+        send_all(fd,
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n");
+      }
+      send_all(fd, body);
+    }
+    catch (const std::exception &e)
+    {
+      BOOST_LOG_TRIVIAL(debug) << "Stats client went away: " << e.what();
+    }
+    ::close(fd);
+  }
+};
+
+stats_exporter::stats_exporter(stats_exporter_settings settings)
+    : _impl(std::make_unique<impl>(std::move(settings)))
+{
+}
+
+stats_exporter::~stats_exporter() = default;
+
+void stats_exporter::log_snapshot()
+{
+  _impl->log_snapshot();
+}
+} // namespace mpegts
@@ -0,0 +1,60 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace mpegts
+{
+struct stats_exporter_settings
+{
+  // JSON snapshot replaced every interval, empty writes none
+  std::string json_file;
+  // Unix socket answering every connection with Prometheus text, plain or as an HTTP response
+  // to a GET request; empty opens none
+  std::string socket_path;
+  std::chrono::milliseconds interval{1000};
+};
+
+// exports process-wide demux statistics, see stats.h; counting is enabled on construction
+// and snapshots are taken on a thread of its own
+class stats_exporter
+{
+public:
+  // throws if the socket can't be opened
+  explicit stats_exporter(stats_exporter_settings settings);
+  // writes the last JSON snapshot and removes the socket
+  ~stats_exporter();
+  stats_exporter(const stats_exporter &) = delete;
+  stats_exporter &operator=(const stats_exporter &) = delete;
+
+  // logs current counters, may be called from any thread
+  void log_snapshot();
+
+private:
+  class impl;
+  std::unique_ptr<impl> _impl;
+};
+} // namespace mpegts
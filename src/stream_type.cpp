@@ -0,0 +1,57 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "stream_type.h"
+
+namespace mpegts
+{
+// https://en.wikipedia.org/wiki/Program-specific_information#Elementary_stream_types
+const char *get_stream_type_extension(uint8_t stream_type)
+{
+  switch (stream_type)
+  {
+    case 0x01:
+      return "m1v";
+    case 0x02:
+      return "m2v";
+    case 0x03:
+    case 0x04:
+      return "mpa";
+    case 0x0f:
+      return "aac";
+    case 0x10:
+      return "m4v";
+    case 0x11:
+      return "latm";
+    case 0x1b:
+      return "h264";
+    case 0x24:
+      return "hevc";
+    case 0x81:
+      return "ac3";
+    case 0x87:
+      return "eac3";
+    default:
+      return nullptr;
+  }
+}
+} // namespace mpegts
@@ -0,0 +1,338 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+// microbenchmarks of the packet path on TS from ts_generator, reported as ns/packet and
+// packets/s; --json writes the results to be diffed between builds
+
+#include "demuxer.h"
+#include "detail/mpegts_detail.h"
+#include "detail/pes_parser.h"
+#include "detail/psi_parser.h"
+#include "detail/ts_header_batch.h"
+#include "detail/ts_parser.h"
+#include "logger.h"
+#include "tools/common/ts_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <boost/log/core.hpp>
+#include <boost/program_options.hpp>
+
+namespace detail = mpegts::detail;
+namespace po = boost::program_options;
+
+namespace
+{
+// results of benchmarked code end up here, so the compiler can't drop the code
+volatile uint64_t observed;
+
+struct bench_settings
+{
+  mpegts::tools::ts_generator_settings generator;
+  size_t packets;
+  size_t repeat;
+  // packets pushed to the demuxer at a time
+  size_t chunk_packets;
+  std::string filter;
+  std::string json_file;
+};
+
+struct bench_result
+{
+  std::string name;
+  size_t packets;
+  // best of the repetitions
+  double seconds;
+
+  double ns_per_packet() const
+  {
+    return seconds * 1e9 / packets;
+  }
+  double packets_per_second() const
+  {
+    return packets / seconds;
+  }
+};
+
+// a media packet with the stream_type PMT gave its PID
+struct media_packet
+{
+  detail::ts_packet_view view;
+  uint8_t stream_type;
+};
+
+struct counting_sink
+{
+  uint64_t *bytes;
+
+  void operator()(detail::pes_packet_impl_t &pes_packet) const
+  {
+    *bytes += pes_packet.data.size();
+  }
+};
+
+uint64_t decode_headers(const std::vector<uint8_t> &data)
+{
+  const detail::pid_filter filter;
+  detail::ts_header_batch batch;
+  const size_t packet_count = data.size() / detail::TS_PACKET_SIZE;
+  uint64_t valid = 0;
+
+  for (size_t i = 0; i < packet_count; i += detail::TS_HEADER_BATCH_SIZE)
+  {
+    detail::decode_ts_headers(data.data() + i * detail::TS_PACKET_SIZE,
+        std::min(detail::TS_HEADER_BATCH_SIZE, packet_count - i), filter, batch);
+    valid += __builtin_popcountll(batch.valid_mask);
+  }
+  return valid;
+}
+
+// header decode and the per-packet checks of Policy, continuity checking among them
+template <typename Policy>
+uint64_t parse_ts(const std::vector<uint8_t> &data)
+{
+  detail::basic_ts_parser<Policy> ts_parser;
+  uint64_t passed = 0;
+
+  ts_parser.parse(data.data(), data.size() / detail::TS_PACKET_SIZE,
+      [&passed](const detail::ts_packet_view &) { ++passed; });
+  return passed;
+}
+
+std::vector<media_packet> find_media_packets(const std::vector<uint8_t> &data)
+{
+  detail::basic_ts_parser<detail::probe_parser_policy> ts_parser;
+  detail::psi_parser psi_parser;
+  std::vector<media_packet> packets;
+
+  ts_parser.parse(data.data(), data.size() / detail::TS_PACKET_SIZE,
+      [&](const detail::ts_packet_view &ts_packet) {
+        if (psi_parser.is_psi_pid(ts_packet.pid))
+        {
+          psi_parser.feed_ts_packet(ts_packet);
+        }
+        else if (psi_parser.is_media_pid(ts_packet.pid))
+        {
+          packets.push_back({ts_packet, psi_parser.get_stream_type(ts_packet.pid)});
+        }
+      });
+  return packets;
+}
+
+uint64_t reassemble_pes(const std::vector<media_packet> &packets)
+{
+  uint64_t bytes = 0;
+  detail::basic_pes_parser<counting_sink, detail::quiet_parser_policy> pes_parser(
+      counting_sink{&bytes});
+
+  for (const auto &packet : packets)
+  {
+    pes_parser.feed_ts_packet(packet.view, packet.stream_type);
+  }
+  pes_parser.flush();
+  return bytes;
+}
+
+uint64_t demux(const std::vector<uint8_t> &data, size_t chunk_size)
+{
+  uint64_t bytes = 0;
+  mpegts::demuxer demuxer([&bytes](const mpegts::pes_batch_t &batch) {
+    for (const auto &pes_packet : batch)
+    {
+      bytes += pes_packet.payload.length;
+    }
+  });
+
+  for (size_t offset = 0; offset < data.size(); offset += chunk_size)
+  {
+    demuxer.push(data.data() + offset, std::min(chunk_size, data.size() - offset));
+  }
+  demuxer.finish();
+  return bytes;
+}
+
+bench_result measure(
+    const std::string &name, size_t packets, size_t repeat, const std::function<uint64_t()> &run)
+{
+  double best = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < repeat; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    observed = observed + run();
+    best = std::min(
+        best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return {name, packets, best};
+}
+
+std::vector<bench_result> run_benchmarks(const bench_settings &settings)
+{
+  mpegts::tools::ts_generator generator(settings.generator);
+  const auto data = generator.generate(settings.packets);
+  const auto media_packets = find_media_packets(data);
+
+  const std::vector<std::pair<std::string, std::function<uint64_t()>>> benchmarks = {
+      {"header_decode", [&data]() { return decode_headers(data); }},
+      {"ts_parse", [&data]() { return parse_ts<detail::probe_parser_policy>(data); }},
+      {"cc_tracking", [&data]() { return parse_ts<detail::quiet_parser_policy>(data); }},
+      {"pes_reassembly", [&media_packets]() { return reassemble_pes(media_packets); }},
+      {"end_to_end", [&data, &settings]() {
+         return demux(data, settings.chunk_packets * detail::TS_PACKET_SIZE);
+       }}};
+
+  std::vector<bench_result> results;
+  for (const auto &benchmark : benchmarks)
+  {
+    if (benchmark.first.find(settings.filter) == std::string::npos)
+    {
+      continue;
+    }
+    // PES reassembly only sees the media packets, still rated per packet of the input
+    results.push_back(
+        measure(benchmark.first, settings.packets, settings.repeat, benchmark.second));
+  }
+  return results;
+}
+
+void print_results(std::ostream &os, const std::vector<bench_result> &results)
+{
+  os << std::left << std::setw(16) << "benchmark" << std::right << std::setw(12) << "ns/packet"
+     << std::setw(16) << "packets/s" << std::setw(12) << "best ms" << "\n";
+  for (const auto &result : results)
+  {
+    os << std::left << std::setw(16) << result.name << std::right << std::fixed
+       << std::setprecision(2) << std::setw(12) << result.ns_per_packet()
+       << std::setprecision(0) << std::setw(16) << result.packets_per_second()
+       << std::setprecision(3) << std::setw(12) << result.seconds * 1e3 << "\n";
+  }
+}
+
+void write_json(std::ostream &os, const bench_settings &settings,
+    const std::vector<bench_result> &results)
+{
+  const auto &generator = settings.generator;
+  os << std::setprecision(10);
+  os << "{\"settings\":{\"packets\":" << settings.packets << ",\"repeat\":" << settings.repeat
+     << ",\"chunk_packets\":" << settings.chunk_packets << ",\"streams\":" << generator.streams
+     << ",\"min_pes_size\":" << generator.min_pes_size
+     << ",\"max_pes_size\":" << generator.max_pes_size
+     << ",\"adaptation_field_rate\":" << generator.adaptation_field_rate
+     << ",\"loss_rate\":" << generator.loss_rate
+     << ",\"corruption_rate\":" << generator.corruption_rate << ",\"seed\":" << generator.seed
+     << "},\"results\":[";
+
+  const char *separator = "";
+  for (const auto &result : results)
+  {
+    os << separator << "{\"name\":\"" << result.name << "\",\"ns_per_packet\":"
+       << result.ns_per_packet() << ",\"packets_per_second\":" << result.packets_per_second()
+       << ",\"best_seconds\":" << result.seconds << "}";
+    separator = ",";
+  }
+  os << "]}\n";
+}
+
+bool parse_options(int argc, char *argv[], bench_settings &settings)
+{
+  auto &generator = settings.generator;
+  po::options_description desc("Allowed options");
+  desc.add_options()("help", "produce help message")("packets",
+      po::value(&settings.packets)->default_value(200000), "TS packets generated")("repeat",
+      po::value(&settings.repeat)->default_value(5), "runs of each benchmark, the best counts")(
+      "chunk", po::value(&settings.chunk_packets)->default_value(512),
+      "packets pushed at a time by end_to_end")("filter", po::value(&settings.filter),
+      "run only benchmarks whose name contains this")("json", po::value(&settings.json_file),
+      "write results to this JSON file")("streams",
+      po::value(&generator.streams)->default_value(generator.streams), "elementary streams")(
+      "min_pes_size", po::value(&generator.min_pes_size)->default_value(generator.min_pes_size),
+      "smallest PES in bytes")("max_pes_size",
+      po::value(&generator.max_pes_size)->default_value(generator.max_pes_size),
+      "largest PES in bytes")("adaptation_rate",
+      po::value(&generator.adaptation_field_rate)
+          ->default_value(generator.adaptation_field_rate),
+      "share of packets with an adaptation field")("loss_rate",
+      po::value(&generator.loss_rate)->default_value(generator.loss_rate),
+      "share of packets dropped")("corruption_rate",
+      po::value(&generator.corruption_rate)->default_value(generator.corruption_rate),
+      "share of packets with a corrupted byte")(
+      "seed", po::value(&generator.seed)->default_value(generator.seed), "generator seed");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << "Usage: " << argv[0] << " [options]\n" << desc;
+    return false;
+  }
+  if (!settings.packets || !settings.repeat || !settings.chunk_packets)
+  {
+    throw po::error("--packets, --repeat and --chunk must be above 0");
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    bench_settings settings;
+    if (!parse_options(argc, argv, settings))
+    {
+      return 1;
+    }
+
+    // warnings about generated loss and corruption would be timed too
+    boost::log::core::get()->set_logging_enabled(false);
+    logger::current_severity_level = boost::log::trivial::fatal;
+
+    const auto results = run_benchmarks(settings);
+    print_results(std::cout, results);
+
+    if (!settings.json_file.empty())
+    {
+      std::ofstream ofs(settings.json_file);
+      if (!ofs)
+      {
+        throw std::runtime_error("can't open " + settings.json_file);
+      }
+      write_json(ofs, settings, results);
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,371 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "tools/common/ts_generator.h"
+#include "detail/crc32_mpeg2.h"
+#include "detail/mpegts_detail.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace mpegts
+{
+namespace tools
+{
+  namespace
+  {
+    // program n has PMT PID FIRST_PMT_PID + n and stream PIDs from FIRST_STREAM_PID + n * 32
+    constexpr uint16_t PAT_PID = 0x0000;
+    constexpr uint16_t FIRST_PMT_PID = 0x1000;
+    constexpr uint16_t FIRST_STREAM_PID = 0x100;
+    constexpr uint16_t TRANSPORT_STREAM_ID = 1;
+
+    constexpr uint8_t H264_STREAM_TYPE = 0x1b;
+    constexpr uint8_t AAC_STREAM_TYPE = 0x0f;
+
+    // PTS step of a 30 fps video frame and of a 1024 sample AAC frame at 48 kHz
+    constexpr uint64_t VIDEO_PTS_STEP = 3000;
+    constexpr uint64_t AUDIO_PTS_STEP = 1920;
+    // PTS lead over PCR, i.e. decoder buffering
+    constexpr uint64_t PTS_DELAY = 45000;
+
+    constexpr uint64_t CLOCK_HZ = 27000000;
+    // adaptation_field_length, flags and the 6 PCR bytes
+    constexpr size_t PCR_ADAPTATION_LENGTH = 8;
+    constexpr uint8_t PCR_FLAG = 0x10;
+
+    // long form section with version 0, current, section 0 of 0, followed by CRC_32
+    std::vector<uint8_t> make_section(
+        uint8_t table_id, uint16_t id, const std::vector<uint8_t> &body)
+    {
+      // section_length counts the bytes after it
+      const size_t length = 5 + body.size() + 4;
+      std::vector<uint8_t> section;
+      section.reserve(3 + length);
+      for (uint8_t byte : {table_id, static_cast<uint8_t>(0xb0 | (length >> 8)),
+               static_cast<uint8_t>(length), static_cast<uint8_t>(id >> 8),
+               static_cast<uint8_t>(id), uint8_t{0xc1}, uint8_t{0x00}, uint8_t{0x00}})
+      {
+        section.push_back(byte);
+      }
+      section.insert(section.end(), body.begin(), body.end());
+
+      const uint32_t crc = detail::crc32_mpeg2::compute(section.data(), section.size());
+      for (int shift = 24; shift >= 0; shift -= 8)
+      {
+        section.push_back(static_cast<uint8_t>(crc >> shift));
+      }
+      return section;
+    }
+
+    void write_pts(uint8_t *out, uint64_t pts)
+    {
+      // '0010' PTS only prefix and marker bits
+      out[0] = static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0e));
+      out[1] = static_cast<uint8_t>(pts >> 22);
+      out[2] = static_cast<uint8_t>(((pts >> 14) & 0xfe) | 0x01);
+      out[3] = static_cast<uint8_t>(pts >> 7);
+      out[4] = static_cast<uint8_t>(((pts << 1) & 0xfe) | 0x01);
+    }
+
+    void write_pcr(uint8_t *out, uint64_t clock)
+    {
+      // 33 bits of 90 kHz base, 6 reserved bits, 9 bits of extension
+      const uint64_t base = clock / 300;
+      const uint64_t extension = clock % 300;
+      out[0] = static_cast<uint8_t>(base >> 25);
+      out[1] = static_cast<uint8_t>(base >> 17);
+      out[2] = static_cast<uint8_t>(base >> 9);
+      out[3] = static_cast<uint8_t>(base >> 1);
+      out[4] = static_cast<uint8_t>(((base & 0x01) << 7) | 0x7e | (extension >> 8));
+      out[5] = static_cast<uint8_t>(extension);
+    }
+
+    void write_header(
+        uint8_t *packet, uint16_t pid, bool pusi, bool adaptation_field, uint8_t &continuity_cnt)
+    {
+      packet[0] = 0x47;
+      packet[1] = static_cast<uint8_t>((pusi ? 0x40 : 0x00) | (pid >> 8));
+      packet[2] = static_cast<uint8_t>(pid);
+      packet[3] = static_cast<uint8_t>((adaptation_field ? 0x30 : 0x10) | continuity_cnt);
+      continuity_cnt = (continuity_cnt + 1) & 0x0f;
+    }
+  } // namespace
+
+  ts_generator::ts_generator(const ts_generator_settings &settings)
+      : _settings(settings),
+        _pcr_interval_ticks(uint64_t{settings.pcr_interval_ms} * CLOCK_HZ / 1000),
+        _random_state(settings.seed)
+  {
+    if (!settings.programs || settings.programs > MAX_PROGRAMS)
+    {
+      throw std::invalid_argument(
+          "program count must be 1 to " + std::to_string(MAX_PROGRAMS));
+    }
+    if (!settings.streams || settings.streams > MAX_STREAMS)
+    {
+      throw std::invalid_argument(
+          "stream count must be 1 to " + std::to_string(MAX_STREAMS));
+    }
+    if (settings.min_pes_size < MIN_PES_SIZE || settings.max_pes_size < settings.min_pes_size ||
+        settings.max_pes_size > detail::MAX_PES_SIZE)
+    {
+      throw std::invalid_argument("PES sizes must be ordered and within " +
+          std::to_string(MIN_PES_SIZE) + " to " + std::to_string(detail::MAX_PES_SIZE));
+    }
+    for (double rate : {settings.adaptation_field_rate, settings.corruption_rate})
+    {
+      if (!(rate >= 0 && rate <= 1))
+      {
+        throw std::invalid_argument("rates must be within 0 to 1");
+      }
+    }
+    if (!(settings.loss_rate >= 0 && settings.loss_rate < 1))
+    {
+      throw std::invalid_argument("loss rate must be at least 0 and below 1");
+    }
+    if (settings.psi_interval <= settings.programs + 1)
+    {
+      throw std::invalid_argument("PSI interval must be longer than PAT and all PMTs");
+    }
+    if (settings.bitrate)
+    {
+      if (!settings.pcr_interval_ms)
+      {
+        throw std::invalid_argument("PCR interval must be above 0");
+      }
+      _packet_ticks = static_cast<double>(detail::TS_PACKET_SIZE) * 8 * CLOCK_HZ /
+                      static_cast<double>(settings.bitrate);
+    }
+
+    std::vector<uint8_t> program_association;
+    for (size_t program = 0; program < settings.programs; ++program)
+    {
+      const uint16_t program_number = static_cast<uint16_t>(program + 1);
+      const uint16_t pmt_pid = static_cast<uint16_t>(FIRST_PMT_PID + program);
+      program_association.insert(program_association.end(),
+          {static_cast<uint8_t>(program_number >> 8), static_cast<uint8_t>(program_number),
+              static_cast<uint8_t>(0xe0 | (pmt_pid >> 8)), static_cast<uint8_t>(pmt_pid)});
+
+      const size_t pcr_stream = _streams.size();
+      const uint16_t pcr_pid = static_cast<uint16_t>(FIRST_STREAM_PID + program * MAX_STREAMS);
+      std::vector<uint8_t> program_map = {static_cast<uint8_t>(0xe0 | (pcr_pid >> 8)),
+          static_cast<uint8_t>(pcr_pid), 0xf0, 0x00};
+      for (size_t i = 0; i < settings.streams; ++i)
+      {
+        const bool video = i % 2 == 0;
+        stream_info stream{program_number, static_cast<uint16_t>(pcr_pid + i),
+            video ? H264_STREAM_TYPE : AAC_STREAM_TYPE,
+            static_cast<uint8_t>((video ? 0xe0 : 0xc0) + i / 2)};
+        _streams.push_back(stream);
+        _states.emplace_back();
+        _states.back().program = program;
+
+        program_map.insert(program_map.end(), {stream.stream_type,
+            static_cast<uint8_t>(0xe0 | (stream.pid >> 8)), static_cast<uint8_t>(stream.pid),
+            0xf0, 0x00});
+      }
+
+      _programs.emplace_back();
+      _programs.back().pmt_pid = pmt_pid;
+      _programs.back().pmt = make_section(0x02, program_number, program_map);
+      _programs.back().pcr_stream = pcr_stream;
+    }
+    _pat = make_section(0x00, TRANSPORT_STREAM_ID, program_association);
+  }
+
+  void ts_generator::next_packet(uint8_t *packet)
+  {
+    do
+    {
+      write_packet(packet);
+      ++_packet_num;
+    } while (next_chance(_settings.loss_rate));
+
+    if (next_chance(_settings.corruption_rate))
+    {
+      packet[next_below(detail::TS_PACKET_SIZE)] ^= static_cast<uint8_t>(1 + next_below(0xff));
+    }
+  }
+
+  std::vector<uint8_t> ts_generator::generate(size_t packet_count)
+  {
+    std::vector<uint8_t> data(packet_count * detail::TS_PACKET_SIZE);
+    for (size_t i = 0; i < packet_count; ++i)
+    {
+      next_packet(data.data() + i * detail::TS_PACKET_SIZE);
+    }
+    return data;
+  }
+
+  void ts_generator::write_packet(uint8_t *packet)
+  {
+    // PAT, then the PMTs in program order
+    const size_t psi_index = _packet_num % _settings.psi_interval;
+    if (!psi_index)
+    {
+      write_psi_packet(packet, PAT_PID, _pat, _pat_continuity_cnt);
+    }
+    else if (psi_index <= _programs.size())
+    {
+      auto &program = _programs[psi_index - 1];
+      write_psi_packet(packet, program.pmt_pid, program.pmt, program.pmt_continuity_cnt);
+    }
+    else
+    {
+      write_pes_packet(packet, next_below(_streams.size()));
+    }
+  }
+
+  void ts_generator::write_psi_packet(uint8_t *packet, uint16_t pid,
+      const std::vector<uint8_t> &section, uint8_t &continuity_cnt)
+  {
+    write_header(packet, pid, true, false, continuity_cnt);
+    // pointer_field, the section, then stuffing
+    packet[4] = 0;
+    std::memcpy(packet + 5, section.data(), section.size());
+    std::memset(packet + 5 + section.size(), 0xff,
+        detail::TS_PACKET_SIZE - 5 - section.size());
+  }
+
+  void ts_generator::write_pes_packet(uint8_t *packet, size_t stream)
+  {
+    auto &state = _states[stream];
+    const bool pusi = state.pes_offset == state.pes.size();
+    if (pusi)
+    {
+      start_pes(stream);
+    }
+
+    // adaptation field bytes, its length byte included; the last packet of a PES is
+    // padded with one
+    const size_t remaining = state.pes.size() - state.pes_offset;
+    size_t adaptation_length = 0;
+    if (remaining < detail::TS_PACKET_DATA_SIZE)
+    {
+      adaptation_length = detail::TS_PACKET_DATA_SIZE - remaining;
+    }
+    else if (next_chance(_settings.adaptation_field_rate))
+    {
+      adaptation_length = 2 + next_below(8);
+    }
+
+    auto &program = _programs[state.program];
+    const uint64_t now = clock();
+    const bool pcr = _settings.bitrate && stream == program.pcr_stream &&
+                     (program.last_pcr == ~uint64_t{0} ||
+                         now - program.last_pcr >= _pcr_interval_ticks);
+    if (pcr)
+    {
+      adaptation_length = std::max(adaptation_length, PCR_ADAPTATION_LENGTH);
+      program.last_pcr = now;
+    }
+
+    write_header(packet, _streams[stream].pid, pusi, adaptation_length, state.continuity_cnt);
+
+    uint8_t *out = packet + 4;
+    if (adaptation_length)
+    {
+      out[0] = static_cast<uint8_t>(adaptation_length - 1);
+      if (adaptation_length > 1)
+      {
+        // PCR or no flags, then stuffing bytes
+        size_t length = 2;
+        out[1] = pcr ? PCR_FLAG : 0x00;
+        if (pcr)
+        {
+          write_pcr(out + 2, now);
+          length = PCR_ADAPTATION_LENGTH;
+        }
+        std::memset(out + length, 0xff, adaptation_length - length);
+      }
+      out += adaptation_length;
+    }
+
+    const size_t payload_length =
+        std::min(remaining, detail::TS_PACKET_DATA_SIZE - adaptation_length);
+    std::memcpy(out, state.pes.data() + state.pes_offset, payload_length);
+    state.pes_offset += payload_length;
+  }
+
+  void ts_generator::start_pes(size_t stream)
+  {
+    auto &state = _states[stream];
+    const auto &info = _streams[stream];
+    const size_t size = _settings.min_pes_size +
+                        next_below(_settings.max_pes_size - _settings.min_pes_size + 1);
+
+    state.pes.resize(size);
+    state.pes_offset = 0;
+
+    // PES_packet_length is 0, i.e. unbounded, when the PES doesn't fit in 16 bits
+    const size_t packet_length = size - 6 <= 0xffff ? size - 6 : 0;
+    uint8_t *out = state.pes.data();
+    const uint8_t header[] = {0x00, 0x00, 0x01, info.stream_id,
+        static_cast<uint8_t>(packet_length >> 8), static_cast<uint8_t>(packet_length), 0x80,
+        0x80, 0x05};
+    std::memcpy(out, header, sizeof(header));
+    if (_settings.bitrate)
+    {
+      state.pts = clock() / 300 + PTS_DELAY;
+    }
+    write_pts(out + sizeof(header), state.pts);
+    state.pts += info.stream_type == H264_STREAM_TYPE ? VIDEO_PTS_STEP : AUDIO_PTS_STEP;
+
+    for (size_t offset = MIN_PES_SIZE; offset < size;)
+    {
+      uint64_t random = next_random();
+      for (size_t i = 0; i < sizeof(random) && offset < size; ++i, random >>= 8)
+      {
+        out[offset++] = static_cast<uint8_t>(random);
+      }
+    }
+    ++_pes_count;
+  }
+
+  uint64_t ts_generator::clock() const
+  {
+    return static_cast<uint64_t>(static_cast<double>(_packet_num) * _packet_ticks);
+  }
+
+  uint64_t ts_generator::next_random()
+  {
+    // splitmix64, fixed output for a seed unlike the std:: distributions
+    uint64_t z = (_random_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t ts_generator::next_below(uint64_t bound)
+  {
+    return next_random() % bound;
+  }
+
+  bool ts_generator::next_chance(double rate)
+  {
+    return static_cast<double>(next_random() >> 11) * 0x1.0p-53 < rate;
+  }
+
+} // namespace tools
+} // namespace mpegts
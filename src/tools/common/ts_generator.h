@@ -0,0 +1,140 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mpegts
+{
+namespace tools
+{
+  struct ts_generator_settings
+  {
+    // programs, each with its own PMT
+    size_t programs = 1;
+    // elementary streams of each program, H.264 and AAC in turn
+    size_t streams = 2;
+    // whole PES, header included
+    size_t min_pes_size = 2000;
+    size_t max_pes_size = 60000;
+    // share of packets with an adaptation field besides those padding the end of a PES
+    double adaptation_field_rate = 0.1;
+    // share of packets dropped
+    double loss_rate = 0;
+    // share of packets with one byte overwritten, header included
+    double corruption_rate = 0;
+    // PAT and every PMT are sent every psi_interval packets
+    size_t psi_interval = 1000;
+    // rate in bits/s the stream is meant to be played at, 0 for none; with a rate PTS follow
+    // the packet clock and the first stream of every program carries PCR, otherwise PTS
+    // advance a frame per PES and there is no PCR
+    uint64_t bitrate = 0;
+    uint32_t pcr_interval_ms = 40;
+    uint64_t seed = 1;
+  };
+
+  // synthetic TS: the same settings give the same bytes on every platform
+  class ts_generator
+  {
+  public:
+    static constexpr size_t MAX_PROGRAMS = 32;
+    static constexpr size_t MAX_STREAMS = 32;
+    static constexpr size_t MIN_PES_SIZE = 14;
+
+    struct stream_info
+    {
+      uint16_t program_number;
+      uint16_t pid;
+      uint8_t stream_type;
+      uint8_t stream_id;
+    };
+
+    // throws std::invalid_argument for settings out of range
+    explicit ts_generator(const ts_generator_settings &settings);
+
+    // writes the next TS_PACKET_SIZE bytes of the stream to packet
+    void next_packet(uint8_t *packet);
+    std::vector<uint8_t> generate(size_t packet_count);
+
+    const std::vector<stream_info> &streams() const
+    {
+      return _streams;
+    }
+    // PES started so far, dropped or not
+    uint64_t pes_count() const
+    {
+      return _pes_count;
+    }
+
+  private:
+    struct program_state
+    {
+      uint16_t pmt_pid;
+      std::vector<uint8_t> pmt;
+      uint8_t pmt_continuity_cnt = 0;
+      // in _streams
+      size_t pcr_stream;
+      // 27 MHz clock of the last PCR, -1 before the first one
+      uint64_t last_pcr = ~uint64_t{0};
+    };
+
+    struct stream_state
+    {
+      size_t program;
+      std::vector<uint8_t> pes;
+      size_t pes_offset = 0;
+      uint8_t continuity_cnt = 0;
+      uint64_t pts = 0;
+    };
+
+    ts_generator_settings _settings;
+    std::vector<stream_info> _streams;
+    std::vector<stream_state> _states;
+    std::vector<program_state> _programs;
+    std::vector<uint8_t> _pat;
+    uint8_t _pat_continuity_cnt = 0;
+    // 27 MHz clock ticks a packet lasts at _settings.bitrate
+    double _packet_ticks = 0;
+    uint64_t _pcr_interval_ticks;
+    uint64_t _packet_num = 0;
+    uint64_t _pes_count = 0;
+    uint64_t _random_state;
+
+    void write_packet(uint8_t *packet);
+    void write_psi_packet(uint8_t *packet, uint16_t pid, const std::vector<uint8_t> &section,
+        uint8_t &continuity_cnt);
+    void write_pes_packet(uint8_t *packet, size_t stream);
+    void start_pes(size_t stream);
+    // 27 MHz clock of the packet being written
+    uint64_t clock() const;
+
+    uint64_t next_random();
+    // uniform in [0, bound)
+    uint64_t next_below(uint64_t bound);
+    bool next_chance(double rate);
+  };
+
+} // namespace tools
+} // namespace mpegts
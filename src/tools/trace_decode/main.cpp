@@ -0,0 +1,142 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+// renders a binary packet trace written with --log_ts_packets or --log_pes_packets as JSON,
+// one object per line
+
+#include "detail/trace_record.h"
+#include "utils.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace trace = mpegts::detail::trace;
+
+namespace
+{
+const char *to_bool(bool value)
+{
+  return value ? "true" : "false";
+}
+
+void print_ts_packet(std::ostream &os, const trace::trace_record &record)
+{
+  os << "\"ts_packet\":{\"num\":" << record.number << ",\"header_bytes_hex\":\""
+     << utils::num_to_hex(record.header, false) << "\",\"pes_packet\":{\"offset\":"
+     << static_cast<unsigned>(record.pes_offset) << "},\"transport_error_indicator\":"
+     << to_bool(record.flags & trace::TRANSPORT_ERROR_FLAG)
+     << ",\"PUSI\":" << to_bool(record.flags & trace::PUSI_FLAG) << ",\"PID\":\""
+     << utils::num_to_hex(record.pid, true)
+     << "\",\"continuity_cnt\":" << static_cast<unsigned>(record.continuity_cnt)
+     << ",\"adaptation_field_ctl\":" << static_cast<unsigned>(record.adaptation_field_ctl)
+     << "}";
+}
+
+void print_pes_packet(std::ostream &os, const trace::trace_record &record)
+{
+  os << "\"pes_packet\":{\"num\":" << record.number
+     << ",\"part\":" << to_bool(!record.payload_offset || !record.payload_length)
+     << ",\"ts_packet\":{\"pid\":\"" << utils::num_to_hex(record.pid, true)
+     << "\"},\"stream_id\":\"" << utils::num_to_hex(record.stream_id, false)
+     << "\",\"max_length\":" << record.max_length << ",\"cur_length\":" << record.cur_length
+     << ",\"payload_offset\":" << record.payload_offset
+     << ",\"payload_length\":" << record.payload_length << "}";
+}
+
+void decode(std::istream &is, std::ostream &os)
+{
+  trace::trace_file_header header{};
+  if (!is.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, trace::TRACE_MAGIC, sizeof(header.magic)) != 0)
+  {
+    throw std::runtime_error("not a packet trace file");
+  }
+  if (header.version != trace::TRACE_VERSION || header.record_size != sizeof(trace::trace_record))
+  {
+    throw std::runtime_error(
+        "unsupported packet trace version " + std::to_string(header.version));
+  }
+
+  std::vector<trace::trace_record> records(4096);
+  while (is)
+  {
+    is.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(records[0]));
+    const size_t count = is.gcount() / sizeof(records[0]);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      const auto &record = records[i];
+
+      os << "{\"thread\":" << record.thread << ",\"time_ns\":" << record.timestamp_ns << ",";
+      switch (record.type)
+      {
+      case trace::record_type::ts_packet:
+        print_ts_packet(os, record);
+        break;
+      case trace::record_type::pes_packet:
+        print_pes_packet(os, record);
+        break;
+      default:
+        throw std::runtime_error("unknown packet trace record type " +
+            std::to_string(static_cast<unsigned>(record.type)));
+      }
+      os << "}\n";
+    }
+  }
+
+  if (is.gcount() % sizeof(trace::trace_record))
+  {
+    std::cerr << "Warning: packet trace ends with a partial record" << std::endl;
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  if (argc != 2)
+  {
+    std::cout << "Usage: " << argv[0] << " <trace_file>\n"
+              << "Prints the packet trace as JSON, one record per line" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    std::ifstream ifs(argv[1], std::ios::binary);
+    if (!ifs)
+    {
+      throw std::runtime_error(std::string("can't open ") + argv[1]);
+    }
+    decode(ifs, std::cout);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,269 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+// synthesises multi-program TS and sends it at a target bitrate to a file, FIFO, stdout or UDP,
+// optionally in bursts and with jitter, to load live inputs of the demuxer
+
+#include "detail/mpegts_detail.h"
+#include "tools/common/ts_generator.h"
+#include "tools/ts_gen/pacer.h"
+#include "tools/ts_gen/ts_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+using mpegts::detail::TS_PACKET_SIZE;
+
+namespace
+{
+struct gen_settings
+{
+  mpegts::tools::ts_generator_settings generator;
+  mpegts::tools::pacer_settings pacer;
+  std::string output;
+  // TS packets per write, i.e. per UDP datagram
+  size_t packets_per_write;
+  // 0 for no limit
+  uint64_t packet_limit;
+  double duration_s;
+  double report_interval_s;
+};
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+  stop_requested = 1;
+}
+
+// bits/s with an optional k, M or G suffix
+uint64_t parse_bitrate(const std::string &value)
+{
+  size_t pos = 0;
+  double rate = 0;
+  try
+  {
+    rate = std::stod(value, &pos);
+  }
+  catch (const std::exception &)
+  {
+  }
+
+  const std::string suffix = value.substr(pos);
+  if (suffix == "k")
+  {
+    rate *= 1e3;
+  }
+  else if (suffix == "M")
+  {
+    rate *= 1e6;
+  }
+  else if (suffix == "G")
+  {
+    rate *= 1e9;
+  }
+  else if (!suffix.empty() || !pos)
+  {
+    rate = 0;
+  }
+
+  if (!(rate >= 1))
+  {
+    throw po::validation_error(po::validation_error::invalid_option_value, "--bitrate", value);
+  }
+  return static_cast<uint64_t>(rate);
+}
+
+bool parse_options(int argc, char *argv[], gen_settings &settings)
+{
+  auto &generator = settings.generator;
+  std::string bitrate;
+  size_t burst_ms;
+  size_t burst_period_ms;
+  size_t jitter_us;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()("help", "produce help message")("bitrate,b",
+      po::value(&bitrate)->default_value("10M"), "output rate in bits/s, k, M and G suffixes")(
+      "packets_per_write", po::value(&settings.packets_per_write)->default_value(7),
+      "TS packets per write or UDP datagram")("packets",
+      po::value(&settings.packet_limit)->default_value(0), "stop after this many packets")(
+      "duration", po::value(&settings.duration_s)->default_value(0),
+      "stop after this many seconds, 0 runs until interrupted")("report_interval",
+      po::value(&settings.report_interval_s)->default_value(5),
+      "seconds between progress lines on stderr, 0 reports at exit only")("burst_factor",
+      po::value(&settings.pacer.burst_factor)->default_value(1),
+      "rate multiplier during bursts")("burst_ms", po::value(&burst_ms)->default_value(0),
+      "burst length in ms, 0 for none")("burst_period_ms",
+      po::value(&burst_period_ms)->default_value(1000), "time from one burst to the next in ms")(
+      "jitter_us", po::value(&jitter_us)->default_value(0),
+      "longest delay of a write from its schedule in us")("programs",
+      po::value(&generator.programs)->default_value(generator.programs), "programs")("streams",
+      po::value(&generator.streams)->default_value(generator.streams),
+      "elementary streams per program")("min_pes_size",
+      po::value(&generator.min_pes_size)->default_value(generator.min_pes_size),
+      "smallest PES in bytes")("max_pes_size",
+      po::value(&generator.max_pes_size)->default_value(generator.max_pes_size),
+      "largest PES in bytes")("adaptation_rate",
+      po::value(&generator.adaptation_field_rate)
+          ->default_value(generator.adaptation_field_rate),
+      "share of packets with an adaptation field")("pcr_interval_ms",
+      po::value(&generator.pcr_interval_ms)->default_value(generator.pcr_interval_ms),
+      "time between PCRs of a program")("loss_rate",
+      po::value(&generator.loss_rate)->default_value(generator.loss_rate),
+      "share of packets dropped")("corruption_rate",
+      po::value(&generator.corruption_rate)->default_value(generator.corruption_rate),
+      "share of packets with a corrupted byte")(
+      "seed", po::value(&generator.seed)->default_value(generator.seed), "generator seed");
+
+  po::options_description hidden_desc("Hidden options");
+  hidden_desc.add_options()("output", po::value(&settings.output));
+  po::options_description parsing_desc;
+  parsing_desc.add(desc).add(hidden_desc);
+  po::positional_options_description pos;
+  pos.add("output", 1);
+
+  auto print_help = [&]() {
+    std::cout << "Usage: " << argv[0] << " [options] <file | fifo | - | udp://address:port>\n"
+              << desc;
+  };
+
+  po::variables_map vm;
+  try
+  {
+    po::store(
+        po::command_line_parser(argc, argv).options(parsing_desc).positional(pos).run(), vm);
+    po::notify(vm);
+    if (vm.count("help"))
+    {
+      print_help();
+      return false;
+    }
+    if (settings.output.empty())
+    {
+      throw po::error("output is required");
+    }
+    if (!settings.packets_per_write)
+    {
+      throw po::validation_error(
+          po::validation_error::invalid_option_value, "--packets_per_write", "0");
+    }
+
+    settings.pacer.bitrate = parse_bitrate(bitrate);
+    settings.pacer.burst_length = std::chrono::milliseconds(burst_ms);
+    settings.pacer.burst_period = std::chrono::milliseconds(burst_period_ms);
+    settings.pacer.jitter = std::chrono::microseconds(jitter_us);
+    // PCR and PTS run at the nominal rate, bursts are a transport effect
+    generator.bitrate = settings.pacer.bitrate;
+  }
+  catch (const po::error &e)
+  {
+    std::cerr << "Error: " << e.what() << "\n";
+    print_help();
+    return false;
+  }
+  return true;
+}
+
+void report(std::ostream &os, uint64_t packets, double seconds, const mpegts::tools::pacer &pacer)
+{
+  os << std::fixed << std::setprecision(1) << seconds << " s: " << packets << " packets, "
+     << std::setprecision(3) << packets * TS_PACKET_SIZE * 8 / seconds / 1e6
+     << " Mbit/s, max lag "
+     << std::chrono::duration_cast<std::chrono::microseconds>(pacer.max_lag()).count()
+     << " us, schedule restarts " << pacer.restarts() << std::endl;
+}
+
+void run(const gen_settings &settings)
+{
+  mpegts::tools::ts_generator generator(settings.generator);
+  mpegts::tools::pacer pacer(settings.pacer);
+  auto output = mpegts::tools::ts_output::open(settings.output);
+
+  std::vector<uint8_t> buffer(settings.packets_per_write * TS_PACKET_SIZE);
+  uint64_t packets = 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto next_report = settings.report_interval_s;
+  double seconds = 0;
+
+  while (!stop_requested && (!settings.packet_limit || packets < settings.packet_limit) &&
+         (!settings.duration_s || seconds < settings.duration_s))
+  {
+    size_t count = settings.packets_per_write;
+    if (settings.packet_limit)
+    {
+      count = std::min<uint64_t>(count, settings.packet_limit - packets);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      generator.next_packet(buffer.data() + i * TS_PACKET_SIZE);
+    }
+
+    pacer.wait(count * TS_PACKET_SIZE);
+    output->write(buffer.data(), count * TS_PACKET_SIZE);
+    packets += count;
+
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (settings.report_interval_s && seconds >= next_report)
+    {
+      report(std::cerr, packets, seconds, pacer);
+      next_report += settings.report_interval_s;
+    }
+  }
+
+  report(std::cerr, packets, std::max(seconds, 1e-9), pacer);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    gen_settings settings;
+    if (!parse_options(argc, argv, settings))
+    {
+      return 1;
+    }
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    // a FIFO reader going away shows up as EPIPE from write()
+    std::signal(SIGPIPE, SIG_IGN);
+
+    run(settings);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "tools/ts_gen/pacer.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace mpegts
+{
+namespace tools
+{
+  namespace
+  {
+    // sleep_until() overshoots by tens of microseconds, the rest is waited for spinning
+    constexpr std::chrono::microseconds SPIN_TIME{100};
+
+    double to_ns(std::chrono::microseconds duration)
+    {
+      return std::chrono::duration<double, std::nano>(duration).count();
+    }
+  } // namespace
+
+  pacer::pacer(const pacer_settings &settings) : _settings(settings)
+  {
+    if (!settings.bitrate)
+    {
+      throw std::invalid_argument("bitrate must be above 0");
+    }
+    if (!(settings.burst_factor > 0))
+    {
+      throw std::invalid_argument("burst factor must be above 0");
+    }
+    if (settings.burst_length.count() &&
+        settings.burst_period.count() <= settings.burst_length.count())
+    {
+      throw std::invalid_argument("burst period must be longer than the burst");
+    }
+  }
+
+  void pacer::wait(size_t bytes)
+  {
+    if (!_started)
+    {
+      _start = clock::now();
+      _started = true;
+    }
+
+    double offset_ns = _next_ns;
+    if (_settings.jitter.count())
+    {
+      std::uniform_real_distribution<double> jitter(0, to_ns(_settings.jitter));
+      offset_ns += jitter(_random);
+    }
+    const auto due = _start + std::chrono::nanoseconds(static_cast<int64_t>(offset_ns));
+
+    auto now = clock::now();
+    if (now < due)
+    {
+      if (due - now > SPIN_TIME)
+      {
+        std::this_thread::sleep_until(due - SPIN_TIME);
+      }
+      while (clock::now() < due)
+      {
+      }
+    }
+    else if (now - due > MAX_LAG)
+    {
+      // the output stalled, sending the backlog at once would be a burst nobody asked for
+      _start += now - due;
+      ++_restarts;
+    }
+    else
+    {
+      _max_lag = std::max(_max_lag, std::chrono::nanoseconds(now - due));
+    }
+
+    const double rate = static_cast<double>(_settings.bitrate) *
+                        (is_in_burst(_next_ns) ? _settings.burst_factor : 1);
+    _next_ns += static_cast<double>(bytes) * 8 * 1e9 / rate;
+  }
+
+  bool pacer::is_in_burst(double offset_ns) const
+  {
+    if (!_settings.burst_length.count())
+    {
+      return false;
+    }
+    return std::fmod(offset_ns, to_ns(_settings.burst_period)) <
+           to_ns(_settings.burst_length);
+  }
+
+} // namespace tools
+} // namespace mpegts
@@ -0,0 +1,86 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace mpegts
+{
+namespace tools
+{
+  struct pacer_settings
+  {
+    // bits/s outside of bursts
+    uint64_t bitrate = 0;
+    // the first burst_length of every burst_period is sent at bitrate * burst_factor
+    double burst_factor = 1;
+    std::chrono::microseconds burst_length{0};
+    std::chrono::microseconds burst_period{0};
+    // every send is delayed from its schedule by up to this much, the average rate stays
+    std::chrono::microseconds jitter{0};
+  };
+
+  // holds sends to an absolute schedule derived from the bitrate, so sleep overshoot never
+  // accumulates into drift; a send which is late goes out at once and the next ones catch up
+  class pacer
+  {
+  public:
+    // schedule falling behind by more than this is restarted rather than caught up with
+    static constexpr std::chrono::seconds MAX_LAG{1};
+
+    // throws std::invalid_argument for settings out of range
+    explicit pacer(const pacer_settings &settings);
+
+    // blocks until bytes are due, the schedule starts at the first call
+    void wait(size_t bytes);
+
+    // the most a send was late, restarts aside
+    std::chrono::nanoseconds max_lag() const
+    {
+      return _max_lag;
+    }
+    uint64_t restarts() const
+    {
+      return _restarts;
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    pacer_settings _settings;
+    bool _started = false;
+    clock::time_point _start;
+    // offset of the next send from _start
+    double _next_ns = 0;
+    std::chrono::nanoseconds _max_lag{0};
+    uint64_t _restarts = 0;
+    std::mt19937_64 _random;
+
+    bool is_in_burst(double offset_ns) const;
+  };
+
+} // namespace tools
+} // namespace mpegts
@@ -0,0 +1,171 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "tools/ts_gen/ts_output.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mpegts
+{
+namespace tools
+{
+  namespace
+  {
+    const std::string UDP_SCHEME = "udp://";
+
+    std::system_error make_error(int error, const std::string &what)
+    {
+      return std::system_error(error, std::generic_category(), what);
+    }
+
+    class fd_output : public ts_output
+    {
+    public:
+      fd_output(int fd, bool owned) : _fd(fd), _owned(owned)
+      {
+      }
+      ~fd_output() override
+      {
+        if (_owned)
+        {
+          ::close(_fd);
+        }
+      }
+
+      void write(const uint8_t *data, size_t length) override
+      {
+        while (length)
+        {
+          const ssize_t written = ::write(_fd, data, length);
+          if (written < 0)
+          {
+            if (errno == EINTR)
+            {
+              continue;
+            }
+            throw make_error(errno, "Failed to write TS");
+          }
+          data += written;
+          length -= static_cast<size_t>(written);
+        }
+      }
+
+    private:
+      int _fd;
+      bool _owned;
+    };
+
+    class udp_output : public ts_output
+    {
+    public:
+      explicit udp_output(const std::string &url)
+      {
+        // address:port
+        const std::string endpoint = url.substr(UDP_SCHEME.size());
+        const auto colon = endpoint.rfind(':');
+        if (colon == std::string::npos || colon + 1 == endpoint.size())
+        {
+          throw std::invalid_argument("Port is missing in " + url);
+        }
+
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        addrinfo *result = nullptr;
+        if (int error = ::getaddrinfo(endpoint.substr(0, colon).c_str(),
+                endpoint.substr(colon + 1).c_str(), &hints, &result))
+        {
+          throw std::invalid_argument("Failed to resolve " + url + ": " + ::gai_strerror(error));
+        }
+
+        _fd = ::socket(result->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (_fd < 0)
+        {
+          const int error = errno;
+          ::freeaddrinfo(result);
+          throw make_error(error, "Failed to create a socket for " + url);
+        }
+        if (::connect(_fd, result->ai_addr, result->ai_addrlen) < 0)
+        {
+          const int error = errno;
+          ::close(_fd);
+          ::freeaddrinfo(result);
+          throw make_error(error, "Failed to connect to " + url);
+        }
+        ::freeaddrinfo(result);
+      }
+      ~udp_output() override
+      {
+        ::close(_fd);
+      }
+
+      void write(const uint8_t *data, size_t length) override
+      {
+        ssize_t sent = 0;
+        do
+        {
+          sent = ::send(_fd, data, length, 0);
+        } while (sent < 0 && errno == EINTR);
+
+        // ICMP port unreachable for an earlier datagram, i.e. nobody is listening yet
+        if (sent < 0 && errno != ECONNREFUSED)
+        {
+          throw make_error(errno, "Failed to send TS");
+        }
+      }
+
+    private:
+      int _fd = -1;
+    };
+  } // namespace
+
+  std::unique_ptr<ts_output> ts_output::open(const std::string &destination)
+  {
+    if (destination == "-")
+    {
+      return std::make_unique<fd_output>(STDOUT_FILENO, false);
+    }
+    if (destination.compare(0, UDP_SCHEME.size(), UDP_SCHEME) == 0)
+    {
+      return std::make_unique<udp_output>(destination);
+    }
+
+    const int fd = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      throw make_error(errno, "Failed to open " + destination);
+    }
+    return std::make_unique<fd_output>(fd, true);
+  }
+
+} // namespace tools
+} // namespace mpegts
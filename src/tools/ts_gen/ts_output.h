@@ -0,0 +1,49 @@
+/*
+
+Copyright 2019 Peter Asanov
+
+Permission is hereby granted, free of charge,
+to any person obtaining a copy of this software and associated documentation files( the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software,
+and to permit persons to whom the Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace mpegts
+{
+namespace tools
+{
+  // where generated TS goes: a file or FIFO path, - for stdout, or udp://address:port
+  class ts_output
+  {
+  public:
+    // throws std::system_error or std::invalid_argument when the destination can't be opened;
+    // opening a FIFO waits for its reader
+    static std::unique_ptr<ts_output> open(const std::string &destination);
+
+    virtual ~ts_output() = default;
+
+    // writes all of data, a UDP output sends it as one datagram; throws std::system_error
+    virtual void write(const uint8_t *data, size_t length) = 0;
+  };
+
+} // namespace tools
+} // namespace mpegts